@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <cstring>
+
+#include "analyze.h"
+#include "page_index.h"
+#include "word_index.h"
+
+#define MIN_TASK_SIZE (1<<16)
+
+// Volume, format and n bytes, then the words, apart by a space
+typedef std::unordered_map<std::string, uint64_t> GramCounts;
+
+// Counts the words of decoder events, and the pairs of them next to each
+// other, into counts
+class GramCounter : public Handler, private WordSplitter
+{
+public:
+	explicit GramCounter(GramCounts& counts) : WordSplitter(false), counts(counts), volume(0) { }
+
+	virtual void begin(const DecoderState& state)
+	{
+		spans = state;
+		volume = 0;
+		previous.clear();
+	}
+	virtual void end() { end_word(); }
+	virtual void page(unsigned volume, unsigned page)
+	{
+		end_word();
+		this->volume = volume;
+		previous.clear();
+	}
+	virtual void span_open(uint8_t format)
+	{
+		end_word();
+		spans.open(format);
+		previous.clear();
+	}
+	virtual void span_close()
+	{
+		end_word();
+		if (spans.span > 0)
+			--spans.span;
+		previous.clear();
+	}
+	virtual void text(const char* text, size_t size) { add(text, size); }
+	virtual void ltr(const char* text, size_t size)
+	{
+		end_word();
+		add(text, size);
+		end_word();
+	}
+	virtual void line_break() { end_word(); }
+	virtual void tab() { end_word(); }
+	virtual void footnote_rule()
+	{
+		end_word();
+		previous.clear();
+	}
+	virtual void unknown_byte(uint8_t byte, uint64_t offset) { end_word(); }
+
+private:
+	virtual void word(const std::string& word)
+	{
+		key.assign(1, (char) volume);
+		key += (char) spans.format();
+		key += '1';
+		key += word;
+		++counts[key];
+		if (!previous.empty())
+		{
+			key[2] = '2';
+			key.replace(3, std::string::npos, previous);
+			key += ' ';
+			key += word;
+			++counts[key];
+		}
+		previous = word;
+	}
+
+	GramCounts& counts;
+	DecoderState spans;
+	unsigned volume;
+	std::string previous;		// Word, while a pair may start with it
+	std::string key;
+};
+
+typedef std::pair<std::string, uint64_t> Gram;
+
+// Volume, class and n first, then the most frequent, then by words
+static bool gram_before(const Gram& a, const Gram& b)
+{
+	int order = a.first.compare(0, 3, b.first, 0, 3);
+	if (order)
+		return order < 0;
+	if (a.second != b.second)
+		return a.second > b.second;
+	return a.first.compare(3, std::string::npos, b.first, 3, std::string::npos) < 0;
+}
+
+static void write_gram(Output& out, const Gram& gram)
+{
+	uint8_t format = gram.first[1];
+	out.number((uint8_t) gram.first[0]);
+	out.put('\t');
+	if (!format)
+		out.write("text");
+	else if (span_class(format))
+		out.write(span_class(format), strlen(span_class(format)));
+	else
+		out.hex(format);
+	out.put('\t');
+	out.put(gram.first[2]);
+	out.put('\t');
+	out.number((unsigned) gram.second);
+	out.put('\t');
+	out.write(gram.first.data() + 3, gram.first.size() - 3);
+	out.put('\n');
+}
+
+void write_analysis(Output& out, const uint8_t* data, size_t size,
+		const std::vector<PageMark>& pages, unsigned jobs)
+{
+	// Runs of pages, as for sahifeh -j, starting at starts
+	size_t task_size = std::max(size / (jobs * 8), (size_t) MIN_TASK_SIZE);
+	std::vector<size_t> starts;
+	split_pages(pages, task_size, starts);
+	std::vector<GramCounts> counts(jobs);
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < jobs; ++i)
+		threads.push_back(std::thread([&, i]()
+		{
+			GramCounter counter(counts[i]);
+			for (size_t task; (task = next++) <= starts.size(); )
+			{
+				const uint8_t* begin = task ? data + pages[starts[task - 1]].offset : data;
+				const uint8_t* end = task < starts.size() ? data + pages[starts[task]].offset : data + size;
+				Decoder decoder(counter, task ? pages[starts[task - 1]].state() : DecoderState());
+				decoder.decode(begin, end, data + size, begin - data);
+				decoder.finish();
+			}
+		}));
+	for (unsigned i = 0; i < jobs; ++i)
+		threads[i].join();
+	threads.clear();
+
+	// Each merging thread takes the grams that hash to it from every table,
+	// and sorts them
+	std::vector<std::vector<Gram> > merged(jobs);
+	for (unsigned i = 0; i < jobs; ++i)
+		threads.push_back(std::thread([&, i]()
+		{
+			std::hash<std::string> hash;
+			GramCounts part;
+			part.reserve(counts[0].size() / jobs);		// Grams mostly found on every thread
+			for (unsigned j = 0; j < jobs; ++j)
+				for (GramCounts::const_iterator gram = counts[j].begin(); gram != counts[j].end(); ++gram)
+					if (hash(gram->first) % jobs == i)
+						part[gram->first] += gram->second;
+			merged[i].assign(part.begin(), part.end());
+			std::sort(merged[i].begin(), merged[i].end(), gram_before);
+		}));
+	for (unsigned i = 0; i < jobs; ++i)
+		threads[i].join();
+	counts.clear();
+
+	// The sorted parts are merged as they are written
+	out.write("# volume\tclass\tn\tcount\twords\n");
+	std::vector<size_t> heads(jobs, 0);
+	for (;;)
+	{
+		int first = -1;
+		for (unsigned i = 0; i < jobs; ++i)
+			if (heads[i] < merged[i].size()
+					&& (first < 0 || gram_before(merged[i][heads[i]], merged[first][heads[first]])))
+				first = i;
+		if (first < 0)
+			break;
+		write_gram(out, merged[first][heads[first]++]);
+	}
+}
@@ -0,0 +1,22 @@
+#ifndef SAHIFEH_ANALYZE_H
+#define SAHIFEH_ANALYZE_H
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decoder.h"
+#include "output.h"
+
+// Counts the words and word pairs of input by volume and by span class, and
+// writes them to out as tab-separated lines of volume, class (like aya, text
+// outside spans, or the format code of an unknown one), n (1 for a word, 2
+// for a pair), count and the words, sorted by volume, class and n,
+// then most frequent first.  Words are split as for the word index.  Pairs
+// do not cross pages, spans or the footnote rule, so that they come out the
+// same however input is split.  Pages are decoded on jobs threads, each
+// counting on its own, and the counts are merged on jobs threads as well.
+void write_analysis(Output& out, const uint8_t* data, size_t size,
+		const std::vector<PageMark>& pages, unsigned jobs);
+
+#endif
@@ -0,0 +1,447 @@
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+#include "async_io.h"
+
+#define READ_HEADROOM MAX_STEP		// In front of each input block
+#define CURRENT_POSITION ((uint64_t) -1)
+
+// Reads and writes carried out while the caller goes on.  Requests name
+// one of the buffers given at creation, which has at most one in flight.
+class IoQueue
+{
+public:
+	virtual ~IoQueue() { }
+	virtual const char* name() const = 0;
+
+	// Reads or writes size bytes at data, which lies in buffer, at offset of
+	// fd, or at its current position with CURRENT_POSITION
+	virtual bool submit(unsigned buffer, bool write, int fd, char* data, size_t size, uint64_t offset) = 0;
+
+	// Waits for a request, and returns its buffer and its result: bytes
+	// read or written, or minus errno
+	virtual bool wait(unsigned& buffer, ssize_t& result) = 0;
+};
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+// io_uring through its system calls, without liburing
+class UringQueue : public IoQueue
+{
+public:
+	UringQueue() : ring_fd(-1), sq(MAP_FAILED), cq(MAP_FAILED), sqes(MAP_FAILED), fixed(false) { }
+	virtual ~UringQueue();
+
+	bool create(const struct iovec* buffers, unsigned count);
+	virtual const char* name() const { return fixed ? "io_uring, fixed buffers" : "io_uring"; }
+	virtual bool submit(unsigned buffer, bool write, int fd, char* data, size_t size, uint64_t offset);
+	virtual bool wait(unsigned& buffer, ssize_t& result);
+
+private:
+	int ring_fd;
+	struct io_uring_params params;
+	void* sq;
+	void* cq;
+	void* sqes;
+	size_t sq_size, cq_size;
+	bool fixed;		// Buffers are registered
+};
+
+UringQueue::~UringQueue()
+{
+	if (sqes != MAP_FAILED)
+		munmap(sqes, params.sq_entries * sizeof(struct io_uring_sqe));
+	if (cq != MAP_FAILED && cq != sq)
+		munmap(cq, cq_size);
+	if (sq != MAP_FAILED)
+		munmap(sq, sq_size);
+	if (ring_fd >= 0)
+		close(ring_fd);
+}
+
+bool UringQueue::create(const struct iovec* buffers, unsigned count)
+{
+	memset(&params, 0, sizeof(params));
+	ring_fd = syscall(__NR_io_uring_setup, count, &params);
+	if (ring_fd < 0)
+		return false;
+	sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		sq_size = cq_size = std::max(sq_size, cq_size);
+	sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		return false;
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		cq = sq;
+	else if ((cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+			IORING_OFF_CQ_RING)) == MAP_FAILED)
+		return false;
+	sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED)
+		return false;
+	// Without registered buffers, plain reads and writes still work
+	fixed = syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS, buffers, count) == 0;
+	return true;
+}
+
+bool UringQueue::submit(unsigned buffer, bool write, int fd, char* data, size_t size, uint64_t offset)
+{
+	char* ring = (char*) sq;
+	unsigned* tail = (unsigned*) (ring + params.sq_off.tail);
+	unsigned mask = *(unsigned*) (ring + params.sq_off.ring_mask);
+	unsigned* array = (unsigned*) (ring + params.sq_off.array);
+	unsigned index = *tail & mask;		// Only this thread moves the tail
+
+	struct io_uring_sqe* sqe = (struct io_uring_sqe*) sqes + index;
+	memset(sqe, 0, sizeof(*sqe));
+	if (fixed)
+	{
+		sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+		sqe->buf_index = buffer;
+	}
+	else
+		sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t) (uintptr_t) data;
+	sqe->len = size;
+	sqe->off = offset;
+	sqe->user_data = buffer;
+	array[index] = index;
+	__atomic_store_n(tail, *tail + 1, __ATOMIC_RELEASE);
+	for (;;)
+	{
+		int submitted = syscall(__NR_io_uring_enter, ring_fd, 1, 0, 0, NULL, 0);
+		if (submitted == 1)
+			return true;
+		if (submitted < 0 && errno != EINTR && errno != EAGAIN)
+			return false;
+	}
+}
+
+bool UringQueue::wait(unsigned& buffer, ssize_t& result)
+{
+	char* ring = (char*) cq;
+	unsigned* head = (unsigned*) (ring + params.cq_off.head);
+	unsigned* tail = (unsigned*) (ring + params.cq_off.tail);
+	unsigned mask = *(unsigned*) (ring + params.cq_off.ring_mask);
+	struct io_uring_cqe* cqes = (struct io_uring_cqe*) (ring + params.cq_off.cqes);
+	while (*head == __atomic_load_n(tail, __ATOMIC_ACQUIRE))
+		if (syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+			return false;
+	const struct io_uring_cqe& cqe = cqes[*head & mask];
+	buffer = cqe.user_data;
+	result = cqe.res;
+	__atomic_store_n(head, *head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+#endif
+
+// Blocking pread() and pwrite() on helper threads, one request each
+class ThreadQueue : public IoQueue
+{
+public:
+	explicit ThreadQueue(unsigned threads);
+	virtual ~ThreadQueue();
+
+	virtual const char* name() const { return "threads"; }
+	virtual bool submit(unsigned buffer, bool write, int fd, char* data, size_t size, uint64_t offset);
+	virtual bool wait(unsigned& buffer, ssize_t& result);
+
+private:
+	struct Request
+	{
+		unsigned buffer;
+		bool write;
+		int fd;
+		char* data;
+		size_t size;
+		uint64_t offset;
+		ssize_t result;
+	};
+
+	void run();
+
+	std::mutex mutex;
+	std::condition_variable submitted, completed;
+	std::deque<Request> requests, results;
+	bool stopping;
+	std::vector<std::thread> threads;
+};
+
+ThreadQueue::ThreadQueue(unsigned threads) : stopping(false)
+{
+	for (unsigned i = 0; i < threads; ++i)
+		this->threads.push_back(std::thread(&ThreadQueue::run, this));
+}
+
+ThreadQueue::~ThreadQueue()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	submitted.notify_all();
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+}
+
+bool ThreadQueue::submit(unsigned buffer, bool write, int fd, char* data, size_t size, uint64_t offset)
+{
+	Request request = { buffer, write, fd, data, size, offset, 0 };
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		requests.push_back(request);
+	}
+	submitted.notify_one();
+	return true;
+}
+
+bool ThreadQueue::wait(unsigned& buffer, ssize_t& result)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (results.empty())
+		completed.wait(lock);
+	buffer = results.front().buffer;
+	result = results.front().result;
+	results.pop_front();
+	return true;
+}
+
+void ThreadQueue::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;)
+	{
+		while (requests.empty() && !stopping)
+			submitted.wait(lock);
+		if (requests.empty())
+			return;
+		Request request = requests.front();
+		requests.pop_front();
+		lock.unlock();
+		do
+		{
+			if (request.offset == CURRENT_POSITION)
+				request.result = request.write ? ::write(request.fd, request.data, request.size)
+					: read(request.fd, request.data, request.size);
+			else
+				request.result = request.write ? pwrite(request.fd, request.data, request.size, request.offset)
+					: pread(request.fd, request.data, request.size, request.offset);
+		}
+		while (request.result < 0 && errno == EINTR);
+		if (request.result < 0)
+			request.result = -errno;
+		lock.lock();
+		results.push_back(request);
+		completed.notify_one();
+	}
+}
+
+AsyncIo::AsyncIo(int in_fd, uint64_t in_size, int out_fd)
+	: in_fd(in_fd), in_size(in_size), blocks((in_size + IO_BLOCK_SIZE - 1) / IO_BLOCK_SIZE), current(0),
+	out_fd(out_fd), out_stream(true), out_offset(0), writing(IO_DEPTH), written(0), in_flight(0),
+	error(false), queue(NULL)
+{
+	for (unsigned i = 0; i < 2 * IO_DEPTH; ++i)
+	{
+		Buffer& buffer = buffers[i];
+		buffer.data = new char[(i < IO_DEPTH ? READ_HEADROOM : 0) + IO_BLOCK_SIZE];
+		buffer.offset = buffer.size = buffer.done = 0;
+		buffer.busy = false;
+	}
+
+	// Regular files take writes at their offsets, in any order, and others
+	// in order.  Appending ignores the offsets.
+	struct stat st;
+	int flags = fcntl(out_fd, F_GETFL);
+	off_t position;
+	if (fstat(out_fd, &st) == 0 && S_ISREG(st.st_mode) && flags >= 0 && !(flags & O_APPEND)
+			&& (position = lseek(out_fd, 0, SEEK_CUR)) >= 0)
+	{
+		out_stream = false;
+		out_offset = position;
+	}
+}
+
+AsyncIo::~AsyncIo()
+{
+	if (queue)
+	{
+		// Requests in flight write into the buffers until they complete
+		unsigned buffer;
+		ssize_t result;
+		for (unsigned i = 0; i < 2 * IO_DEPTH; ++i)
+			while (buffers[i].busy && queue->wait(buffer, result))
+				buffers[buffer].busy = false;
+		delete queue;
+	}
+	for (unsigned i = 0; i < 2 * IO_DEPTH; ++i)
+		delete [] buffers[i].data;
+}
+
+bool AsyncIo::start(IoBackend backend)
+{
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+	if (backend == IO_URING)
+	{
+		struct iovec iovecs[2 * IO_DEPTH];
+		for (unsigned i = 0; i < 2 * IO_DEPTH; ++i)
+		{
+			iovecs[i].iov_base = buffers[i].data;
+			iovecs[i].iov_len = (i < IO_DEPTH ? READ_HEADROOM : 0) + IO_BLOCK_SIZE;
+		}
+		UringQueue* uring = new UringQueue();
+		if (uring->create(iovecs, 2 * IO_DEPTH))
+			queue = uring;
+		else
+			delete uring;
+	}
+#endif
+	if (queue == NULL)
+		queue = new ThreadQueue(2 * IO_DEPTH);
+	for (uint64_t block = 0; block < IO_DEPTH && block < blocks; ++block)
+		read_block(block);
+	return !error;
+}
+
+const char* AsyncIo::backend() const
+{
+	return queue ? queue->name() : "none";
+}
+
+void AsyncIo::read_block(uint64_t block)
+{
+	unsigned index = block % IO_DEPTH;
+	Buffer& buffer = buffers[index];
+	buffer.offset = block * IO_BLOCK_SIZE;
+	buffer.size = std::min((uint64_t) IO_BLOCK_SIZE, in_size - buffer.offset);
+	buffer.done = 0;
+	if (!submit(index))
+		error = true;
+}
+
+bool AsyncIo::submit(unsigned index)
+{
+	Buffer& buffer = buffers[index];
+	bool write = index >= IO_DEPTH;
+	char* data = buffer.data + (write ? 0 : READ_HEADROOM) + buffer.done;
+	uint64_t offset = write && out_stream ? CURRENT_POSITION : buffer.offset + buffer.done;
+	buffer.busy = queue->submit(index, write, write ? out_fd : in_fd, data, buffer.size - buffer.done, offset);
+	return buffer.busy;
+}
+
+bool AsyncIo::complete()
+{
+	unsigned index;
+	ssize_t result;
+	if (!queue->wait(index, result) || index >= 2 * IO_DEPTH)
+		return false;
+	Buffer& buffer = buffers[index];
+	buffer.busy = false;
+	if (result == -EINTR || result == -EAGAIN)
+		result = 0;
+	else if (result < 0 || (result == 0 && index >= IO_DEPTH))
+		return false;
+	else if (result == 0)		// The file got shorter
+		buffer.size = buffer.done;
+	buffer.done += result;
+	if (buffer.done < buffer.size)		// Short, so the rest is asked for again
+		return submit(index);
+	if (index >= IO_DEPTH)
+		--in_flight;
+	return true;
+}
+
+bool AsyncIo::next_block(size_t keep, const uint8_t*& data, size_t& size, bool& last)
+{
+	if (error || current == blocks)
+		return false;
+	Buffer& buffer = buffers[current % IO_DEPTH];
+	while (buffer.busy)
+		if (!complete())
+		{
+			error = true;
+			return false;
+		}
+	if (current > 0)
+	{
+		// Bytes kept from the block before go in front, and its buffer goes
+		// on to read further ahead
+		const Buffer& previous = buffers[(current - 1) % IO_DEPTH];
+		memcpy(buffer.data + READ_HEADROOM - keep, previous.data + READ_HEADROOM + previous.done - keep, keep);
+		if (current - 1 + IO_DEPTH < blocks)
+			read_block(current - 1 + IO_DEPTH);
+	}
+	data = (const uint8_t*) buffer.data + READ_HEADROOM - keep;
+	size = keep + buffer.done;
+	last = ++current == blocks || buffer.done < IO_BLOCK_SIZE;
+	if (last)
+		current = blocks;
+	return !error;
+}
+
+bool AsyncIo::write(const char* data, size_t size)
+{
+	while (size && !error)
+	{
+		if (written == 0)
+		{
+			// The buffer must be free, and for a stream no write in flight
+			while ((buffers[writing].busy || (out_stream && in_flight)) && !error)
+				if (!complete())
+					error = true;
+			if (error)
+				break;
+		}
+		size_t n = std::min(size, (size_t) IO_BLOCK_SIZE - written);
+		memcpy(buffers[writing].data + written, data, n);
+		written += n;
+		data += n;
+		size -= n;
+		if (written == IO_BLOCK_SIZE)
+			write_block();
+	}
+	return !error;
+}
+
+void AsyncIo::write_block()
+{
+	Buffer& buffer = buffers[writing];
+	buffer.offset = out_offset;
+	buffer.size = written;
+	buffer.done = 0;
+	out_offset += written;
+	written = 0;
+	++in_flight;
+	if (!submit(writing))
+		error = true;
+	writing = IO_DEPTH + (writing + 1) % IO_DEPTH;
+}
+
+bool AsyncIo::finish()
+{
+	if (written && !error)
+		write_block();
+	while (in_flight && !error)
+		if (!complete())
+			error = true;
+	if (!out_stream && !error)
+		lseek(out_fd, out_offset, SEEK_SET);		// As if written in order
+	return !error;
+}
@@ -0,0 +1,78 @@
+#ifndef SAHIFEH_ASYNC_IO_H
+#define SAHIFEH_ASYNC_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decoder.h"
+#include "output.h"
+
+#define IO_BLOCK_SIZE (1<<20)
+#define IO_DEPTH 4		// Reads, and writes, in flight at once
+
+enum IoBackend
+{
+	IO_URING,		// Falls back to IO_THREADS where io_uring is missing
+	IO_THREADS,		// pread() and pwrite() on helper threads
+};
+
+class IoQueue;
+
+// Reads a file ahead and writes output behind, with several requests in
+// flight each way, so that waiting for the disk or the network overlaps
+// decoding.  Buffers are allocated once, and registered with the kernel
+// for io_uring.  Input comes in order, a block at a time, each with room
+// in front of it for the last few bytes of the one before; output is taken
+// as an OutputSink.  All of it is used from one thread.
+class AsyncIo : public OutputSink
+{
+public:
+	AsyncIo(int in_fd, uint64_t in_size, int out_fd);
+	virtual ~AsyncIo();
+
+	bool start(IoBackend backend);
+	const char* backend() const;		// Used after start(), like "io_uring"
+
+	// Moves to the next block of input.  keep bytes from the end of the
+	// current one are put in front of it, and data and size cover both.
+	// Returns false at the end of input, or on error.
+	bool next_block(size_t keep, const uint8_t*& data, size_t& size, bool& last);
+
+	virtual bool write(const char* data, size_t size);
+	bool finish();		// Waits for all output, and tells whether all went well
+	bool failed() const { return error; }
+
+private:
+	AsyncIo(const AsyncIo&);
+	AsyncIo& operator=(const AsyncIo&);
+
+	struct Buffer
+	{
+		char* data;
+		uint64_t offset;	// In the file
+		size_t size;		// To read or write there
+		size_t done;		// Of size
+		bool busy;
+	};
+
+	void read_block(uint64_t block);
+	void write_block();		// The one being filled
+	bool submit(unsigned buffer);
+	bool complete();		// Waits for a request to complete, and handles it
+
+	int in_fd;
+	uint64_t in_size;
+	uint64_t blocks;		// Of input
+	uint64_t current;		// Input block handed out last, plus one
+	int out_fd;
+	bool out_stream;		// Written in order, one request at a time
+	uint64_t out_offset;	// Of the next write
+	unsigned writing;		// Write buffer being filled, or to be
+	size_t written;			// Into it
+	unsigned in_flight;		// Writes
+	bool error;
+	Buffer buffers[2 * IO_DEPTH];	// Reads, then writes
+	IoQueue* queue;
+};
+
+#endif
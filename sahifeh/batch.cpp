@@ -0,0 +1,375 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "page_index.h"
+
+#define BATCH_TASK_SIZE (1<<20)		// Bytes of input per task, at least
+
+// Runs tasks on a pool of threads.  Each thread takes the tasks it queued
+// itself newest first, and when it has none, steals the oldest task of
+// another thread, so that a thread that splits a large job in tasks keeps
+// the others busy with it.
+class TaskPool
+{
+public:
+	typedef std::function<void (unsigned worker)> Task;
+
+	explicit TaskPool(unsigned threads) : queues(threads), pending(0) { }
+
+	void push(unsigned worker, const Task& task)
+	{
+		++pending;
+		{
+			std::lock_guard<std::mutex> lock(queues[worker].mutex);
+			queues[worker].tasks.push_back(task);
+		}
+		idle.notify_one();
+	}
+
+	void run();		// Until there are no tasks left
+
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	bool take(unsigned worker, Task& task);
+
+	std::vector<Queue> queues;		// One per thread
+	std::atomic<size_t> pending;	// Tasks queued or running
+	std::mutex idle_mutex;
+	std::condition_variable idle;
+};
+
+bool TaskPool::take(unsigned worker, Task& task)
+{
+	{
+		Queue& own = queues[worker];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty())
+		{
+			task.swap(own.tasks.back());
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+	for (size_t i = 1; i < queues.size(); ++i)
+	{
+		Queue& other = queues[(worker + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(other.mutex);
+		if (!other.tasks.empty())
+		{
+			task.swap(other.tasks.front());
+			other.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void TaskPool::run()
+{
+	std::vector<std::thread> threads;
+	for (unsigned worker = 0; worker < queues.size(); ++worker)
+		threads.push_back(std::thread([this, worker]()
+		{
+			for (;;)
+			{
+				Task task;
+				if (take(worker, task))
+				{
+					task(worker);
+					if (--pending == 0)
+						idle.notify_all();
+					continue;
+				}
+				std::unique_lock<std::mutex> lock(idle_mutex);
+				if (pending == 0)
+					break;
+				idle.wait_for(lock, std::chrono::milliseconds(1));
+			}
+		}));
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+}
+
+struct BatchRange		// A run of whole pages of a file
+{
+	const uint8_t* begin;
+	const uint8_t* end;
+	DecoderState state;
+	std::string output;
+	bool done;
+};
+
+struct BatchFile
+{
+	std::string input;
+	std::string output;
+	std::string error;		// Empty while all is well
+
+	const uint8_t* data;
+	size_t size;
+	Output* out;
+	int out_fd;
+	size_t pages;
+	uint64_t output_size;
+	std::chrono::steady_clock::time_point start;
+	double seconds;
+
+	std::mutex mutex;		// For what follows
+	std::vector<BatchRange> ranges;
+	size_t written;			// Ranges written so far
+};
+
+static double since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Closes the output of a file, once all its ranges are written or on error
+static void finish_file(BatchFile& file, Format format)
+{
+	if (file.out)
+	{
+		if (file.error.empty())
+		{
+			write_footer(format, *file.out);
+			file.output_size = file.out->size();		// With header and footer
+			if (!file.out->flush())
+				file.error = "Failed to write output";
+		}
+		delete file.out;
+		file.out = NULL;
+	}
+	if (file.out_fd >= 0 && close(file.out_fd) != 0 && file.error.empty())
+		file.error = "Failed to write output";
+	if (!file.error.empty() && file.out_fd >= 0)
+		unlink(file.output.c_str());
+	if (file.data)
+		munmap((void*) file.data, file.size);
+	file.data = NULL;
+	file.seconds = since(file.start);
+}
+
+// Decodes a range of a file, and writes out the ranges that are then ready
+static void decode_range(BatchFile& file, size_t index, Format format)
+{
+	BatchRange& range = file.ranges[index];
+	std::string output;
+	{
+		Output range_out(output);
+		Handler* writer = new_writer(format, range_out);
+		Decoder decoder(*writer, range.state);
+		decoder.decode(range.begin, range.end, file.data + file.size, range.begin - file.data);
+		decoder.finish();
+		delete writer;
+	}
+	std::lock_guard<std::mutex> lock(file.mutex);
+	range.output.swap(output);
+	range.done = true;
+	for (; file.written < file.ranges.size() && file.ranges[file.written].done; ++file.written)
+	{
+		std::string& ready = file.ranges[file.written].output;
+		file.out->write(ready.data(), ready.size());
+		std::string().swap(ready);
+	}
+	if (file.written == file.ranges.size())
+		finish_file(file, format);
+}
+
+// Maps a file and splits it into tasks of whole pages for the pool
+static void open_file(TaskPool& pool, unsigned worker, BatchFile& file, Format format)
+{
+	file.start = std::chrono::steady_clock::now();
+	int fd = open(file.input.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0)
+		file.error = "Failed to open input file";
+	else if (st.st_size > 0)
+	{
+		void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr == MAP_FAILED)
+			file.error = "Failed to map input file";
+		else
+		{
+			file.data = (const uint8_t*) addr;
+			file.size = st.st_size;
+		}
+	}
+	if (fd >= 0)
+		close(fd);
+	if (file.error.empty() && (file.out_fd = open(file.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+		file.error = "Failed to create output file";
+	if (!file.error.empty())
+	{
+		finish_file(file, format);
+		return;
+	}
+
+	std::vector<PageMark> pages;
+	scan_pages(file.data, file.data + file.size, pages);
+	file.pages = pages.size();
+	std::vector<size_t> starts;
+	split_pages(pages, BATCH_TASK_SIZE, starts);
+	BatchRange range = { file.data, file.data + file.size, DecoderState(), std::string(), false };
+	for (size_t i = 0; i < starts.size(); ++i)
+	{
+		const PageMark& start = pages[starts[i]];
+		range.end = file.data + start.offset;
+		file.ranges.push_back(range);
+		range.begin = file.data + start.offset;
+		range.state = start.state();
+	}
+	range.end = file.data + file.size;
+	file.ranges.push_back(range);
+
+	file.out = new Output(file.out_fd);
+	write_header(format, *file.out);
+	BatchFile* target = &file;
+	for (size_t i = file.ranges.size(); i-- > 0; )		// The first range is taken first
+		pool.push(worker, [target, i, format](unsigned) { decode_range(*target, i, format); });
+}
+
+static bool has_cdf_extension(const char* name)
+{
+	size_t length = strlen(name);
+	return length > 4 && !strcasecmp(name + length - 4, ".cdf");
+}
+
+static bool list_inputs(const char* source, std::vector<std::string>& inputs)
+{
+	struct stat st;
+	if (stat(source, &st) != 0)
+		return false;
+	if (S_ISDIR(st.st_mode))
+	{
+		DIR* dir = opendir(source);
+		if (dir == NULL)
+			return false;
+		while (struct dirent* entry = readdir(dir))
+		{
+			std::string path = std::string(source) + "/" + entry->d_name;
+			if (has_cdf_extension(entry->d_name) && stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+				inputs.push_back(path);
+		}
+		closedir(dir);
+		std::sort(inputs.begin(), inputs.end());
+		return true;
+	}
+	FILE* f = fopen(source, "r");
+	if (f == NULL)
+		return false;
+	char line[4096];
+	while (fgets(line, sizeof(line), f))
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+		if (*line)
+			inputs.push_back(line);
+	}
+	fclose(f);
+	return true;
+}
+
+static std::string output_path(const std::string& input, const char* outdir, Format format)
+{
+	size_t slash = input.rfind('/');
+	std::string name = slash == std::string::npos ? input : input.substr(slash + 1);
+	size_t dot = name.rfind('.');
+	if (dot != std::string::npos && dot > 0)
+		name.erase(dot);
+	name += std::string(".") + format_extensions[format];
+	if (outdir)
+		return std::string(outdir) + "/" + name;
+	return slash == std::string::npos ? name : input.substr(0, slash + 1) + name;
+}
+
+// Inputs of the same name in different directories, or listed twice, would
+// be written to the same path at once; the later ones get _2, _3, ... added
+static std::string unique_path(const std::string& path, std::set<std::string>& used)
+{
+	std::string unique = path;
+	size_t slash = path.rfind('/');
+	size_t dot = path.rfind('.');
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		dot = path.size();
+	for (unsigned n = 2; !used.insert(unique).second; ++n)
+		unique = path.substr(0, dot) + "_" + std::to_string(n) + path.substr(dot);
+	return unique;
+}
+
+int convert_batch(const char* source, const char* outdir, Format format, unsigned jobs)
+{
+	std::vector<std::string> inputs;
+	if (!list_inputs(source, inputs))
+	{
+		fputs("Error: Failed to read batch list\n", stderr);
+		return -1;
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<BatchFile> files(inputs.size());
+	TaskPool pool(jobs);
+	std::set<std::string> outputs;
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		BatchFile& file = files[i];
+		file.input = inputs[i];
+		file.output = unique_path(output_path(inputs[i], outdir, format), outputs);
+		file.data = NULL;
+		file.size = 0;
+		file.out = NULL;
+		file.out_fd = -1;
+		file.pages = 0;
+		file.output_size = 0;
+		file.seconds = 0;
+		file.written = 0;
+		BatchFile* target = &file;
+		pool.push(i % jobs, [&pool, target, format](unsigned worker) { open_file(pool, worker, *target, format); });
+	}
+	pool.run();
+
+	// One line per file, then the totals of those converted
+	int failed = 0;
+	uint64_t input_total = 0, output_total = 0, pages_total = 0;
+	printf("# input\toutput\tpages\tinput_bytes\toutput_bytes\tseconds\tstatus\n");
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		const BatchFile& file = files[i];
+		printf("%s\t%s\t%zu\t%zu\t%llu\t%.3f\t%s\n", file.input.c_str(), file.output.c_str(), file.pages,
+				file.size, (unsigned long long) file.output_size, file.seconds,
+				file.error.empty() ? "ok" : ("Error: " + file.error).c_str());
+		if (!file.error.empty())
+		{
+			++failed;
+			continue;
+		}
+		input_total += file.size;
+		output_total += file.output_size;
+		pages_total += file.pages;
+	}
+	double seconds = since(start);
+	printf("# %zu files, %d failed, %llu pages, %llu bytes in, %llu bytes out, %.3f seconds, %.2f MB/s\n",
+			files.size(), failed, (unsigned long long) pages_total, (unsigned long long) input_total,
+			(unsigned long long) output_total, seconds, seconds > 0 ? input_total / seconds / 1e6 : 0.0);
+	return failed;
+}
@@ -0,0 +1,14 @@
+#ifndef SAHIFEH_BATCH_H
+#define SAHIFEH_BATCH_H
+
+#include "writer.h"
+
+// Converts the Cdf files of a directory, or those listed one per line in a
+// file, on jobs threads.  Each output is named after its input, with the
+// extension of format, in outdir or else next to the input, and with _2,
+// _3, ... added to names taken by an earlier input.  A file that fails is
+// reported and skipped.  Prints a summary of every file to stdout and
+// returns the number of files that failed.
+int convert_batch(const char* source, const char* outdir, Format format, unsigned jobs);
+
+#endif
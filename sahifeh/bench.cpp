@@ -0,0 +1,269 @@
+// Measures decoder throughput on a synthetic Cdf corpus.
+//
+// Usage: sahifeh_bench [--min-size N] [--max-size N] [--seed N]
+//
+// Sizes take K, M and G suffixes and default to 1K and 1G, growing by a
+// factor of 4.  The largest size needs about 3.5 times its size in memory.
+// Results are tab-separated, one line per size and stage:
+//
+//	stage	input_bytes	output_bytes	iterations	seconds	mb_per_s	ns_per_byte
+//
+// where seconds is per iteration and rates are per input byte.  The decode
+// stage decodes into memory, and the output stage writes its result to
+// /dev/null through an Output, a glyph's worth of bytes at a time.
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "decoder.h"
+#include "html.h"
+#include "output.h"
+
+#define MIN_SECONDS 0.2		// Small sizes are repeated for at least this long
+#define GLYPH_SIZE 2		// Most Persian letters are 2 bytes of UTF-8
+
+class Corpus
+{
+public:
+	explicit Corpus(uint64_t seed) : random_state(seed | 1), volume(1), page(1) { }
+
+	// Appends pages until data holds size bytes
+	void generate(std::vector<uint8_t>& data, size_t size)
+	{
+		data.clear();
+		data.reserve(size + 8192);
+		while (data.size() < size)
+			add_page(data);
+		data.resize(size);
+	}
+
+private:
+	uint32_t random(uint32_t n)		// Uniform in 0..n-1, from xorshift64*
+	{
+		random_state ^= random_state >> 12;
+		random_state ^= random_state << 25;
+		random_state ^= random_state >> 27;
+		return (uint32_t) ((random_state * 2685821657736338717ULL) >> 32) % n;
+	}
+
+	bool chance(uint32_t percent)
+	{
+		return random(100) < percent;
+	}
+
+	void add_page(std::vector<uint8_t>& data)
+	{
+		const uint8_t mark[] = { 0x82, 0x01, 0x00, volume, (uint8_t) page, (uint8_t) (page >> 8), 0x75 };
+		data.insert(data.end(), mark, mark + sizeof(mark));
+		if (++page > 500)
+		{
+			page = 1;
+			volume = volume % 22 + 1;
+		}
+		size_t end = data.size() + 2500 + random(1500);
+		while (data.size() < end)
+			add_paragraph(data, false);
+		if (chance(40))		// Footnotes, below a rule
+		{
+			data.push_back(0x85);
+			data.push_back(0x7D);
+			data.push_back(0x0B);
+			for (int i = 1 + random(3); i > 0; --i)
+				add_paragraph(data, true);
+			data.push_back(0x80);
+		}
+	}
+
+	// Adds a paragraph, sometimes in a span of a title, hadith, aya, poem or
+	// comment, with some hadithes and ayas quoted in it
+	void add_paragraph(std::vector<uint8_t>& data, bool footnote)
+	{
+		static const uint8_t classes[] = { 0x01, 0x03, 0x04, 0x05, 0x08 };
+		static const uint8_t footnote_classes[] = { 0x0C, 0x0D, 0x0E, 0x0F };
+		bool span = chance(15);
+		if (span)
+		{
+			data.push_back(random(2) ? 0x7D : 0x7E);
+			data.push_back(footnote ? footnote_classes[random(sizeof(footnote_classes))] : classes[random(sizeof(classes))]);
+		}
+		for (int words = 8 + random(60); words > 0; --words)
+		{
+			if (chance(3))
+			{
+				data.push_back(0x7E);
+				data.push_back(footnote ? footnote_classes[random(2)] : classes[1 + random(2)]);
+				add_words(data, 3 + random(10));
+				data.push_back(0x80);
+			}
+			else
+				add_words(data, 1);
+		}
+		data.push_back(0x65);
+		if (span)
+			data.push_back(0x80);
+		data.push_back(0x75);
+	}
+
+	void add_words(std::vector<uint8_t>& data, int words)
+	{
+		// Letters as pairs of their final and initial form
+		static const uint8_t letters[] = { 0xBD, 0xBF, 0xC1, 0xC4, 0xC6, 0xC8, 0xCA, 0xCC, 0xD3, 0xD5, 0xD7, 0xD9, 0xE6, 0xE8, 0xEA, 0xEC, 0xF1, 0xF3 };
+		static const uint8_t separate[] = { 0xB2, 0xCE, 0xCF, 0xD0, 0xD1, 0xF8, 0xB0, 0xEE, 0xF5 };
+		static const uint8_t diacritics[] = { 0x97, 0x98, 0x99, 0x9C, 0xAC };
+		for (; words > 0; --words)
+		{
+			if (chance(8))
+				data.push_back(0x01 + random(8));		// Common words
+			else if (chance(2))
+			{
+				for (int digits = 1 + random(4); digits > 0; --digits)
+					data.push_back(0x8D + random(10));
+			}
+			else if (chance(1))
+				add_english(data);
+			else
+				for (int length = 2 + random(6); length > 0; --length)
+				{
+					if (chance(15))
+						data.push_back(separate[random(sizeof(separate))]);
+					else
+						data.push_back(letters[random(sizeof(letters))] + (length > 1));
+					if (chance(5))
+						data.push_back(diacritics[random(sizeof(diacritics))]);
+				}
+			data.push_back(chance(5) ? 0x69 : 0x20);
+		}
+	}
+
+	void add_english(std::vector<uint8_t>& data)
+	{
+		const uint8_t start[] = { 0x81, 0x01, 0x02 };
+		const uint8_t end[] = { 0x7A, 0x00, 0x01 };
+		data.insert(data.end(), start, start + sizeof(start));
+		for (int length = 5 + random(40); length > 0; --length)
+			data.push_back(chance(15) ? 0x20 : 0xA7 + random(26));
+		data.insert(data.end(), end, end + sizeof(end));
+	}
+
+	uint64_t random_state;
+	uint8_t volume;
+	uint16_t page;
+};
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char* stage, size_t size, size_t output_size, unsigned iterations, double seconds)
+{
+	seconds /= iterations;
+	printf("%s\t%zu\t%zu\t%u\t%.9f\t%.2f\t%.3f\n", stage, size, output_size, iterations,
+			seconds, size / seconds / 1e6, seconds * 1e9 / size);
+	fflush(stdout);
+}
+
+static bool parse_size(const char* text, size_t& size)
+{
+	char* suffix;
+	size = strtoull(text, &suffix, 10);
+	switch (*suffix)
+	{
+		case 'G':
+			size <<= 10;
+		case 'M':
+			size <<= 10;
+		case 'K':
+			size <<= 10;
+			++suffix;
+			break;
+		default:
+			break;
+	}
+	return size > 0 && !*suffix;
+}
+
+int main(int argc, const char* argv[])
+{
+	size_t min_size = 1 << 10;
+	size_t max_size = (size_t) 1 << 30;
+	uint64_t seed = 1;
+	for (int arg = 1; arg < argc; ++arg)
+	{
+		bool ok = arg + 1 < argc;
+		if (ok && !strcmp(argv[arg], "--min-size"))
+			ok = parse_size(argv[++arg], min_size);
+		else if (ok && !strcmp(argv[arg], "--max-size"))
+			ok = parse_size(argv[++arg], max_size);
+		else if (ok && !strcmp(argv[arg], "--seed"))
+			seed = strtoull(argv[++arg], NULL, 10);
+		else
+			ok = false;
+		if (!ok)
+		{
+			fputs("Usage: sahifeh_bench [--min-size N] [--max-size N] [--seed N]\n", stderr);
+			return 1;
+		}
+	}
+	int null_fd = open("/dev/null", O_WRONLY);
+	if (null_fd < 0)
+	{
+		fputs("Error: Failed to open /dev/null\n", stderr);
+		return 1;
+	}
+
+	// Unknown bytes and formats are reported on stderr; the corpus has none
+	std::vector<uint8_t> corpus;
+	Corpus(seed).generate(corpus, max_size);
+
+	printf("# stage\tinput_bytes\toutput_bytes\titerations\tseconds\tmb_per_s\tns_per_byte\n");
+	std::string decoded;
+	for (size_t size = min_size; size <= max_size; size *= 4)
+	{
+		const uint8_t* data = corpus.data();
+		decoded.reserve(size / 2 * 5);		// Output is about twice the input
+		unsigned iterations = 0;
+		double start = now(), elapsed;
+		do
+		{
+			decoded.clear();
+			Output out(decoded);
+			HtmlWriter writer(out);
+			Decoder decoder(writer);
+			decoder.decode(data, data + size, data + size);
+			decoder.finish();
+			out.flush();
+			++iterations;
+		}
+		while ((elapsed = now() - start) < MIN_SECONDS);
+		report("decode", size, decoded.size(), iterations, elapsed);
+
+		iterations = 0;
+		start = now();
+		do
+		{
+			Output out(null_fd);
+			const char* text = decoded.data();
+			size_t left = decoded.size();
+			for (; left >= GLYPH_SIZE; left -= GLYPH_SIZE, text += GLYPH_SIZE)
+				out.write(text, GLYPH_SIZE);
+			out.write(text, left);
+			out.flush();
+			++iterations;
+		}
+		while ((elapsed = now() - start) < MIN_SECONDS);
+		report("output", size, decoded.size(), iterations, elapsed);
+
+		if (size > max_size / 4)
+			break;
+	}
+	close(null_fd);
+	return 0;
+}
@@ -1,40 +1,66 @@
-#include <list>
+#include <vector>
 #include <cstdio>
+#include <cstring>
 #include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-void hex_print(FILE* f, const uint8_t* data, uint32_t length)
+#include "output.h"
+
+#define HEADER_SIZE 16
+#define STREAM_BLOCKS 4096		// Read at a time with --stream
+
+struct HexTable		// "xx " of every byte
+{
+	char text[256][3];
+
+	HexTable()
+	{
+		static const char hex_digits[] = "0123456789abcdef";
+		for (int i = 0; i < 256; ++i)
+		{
+			text[i][0] = hex_digits[i >> 4];
+			text[i][1] = hex_digits[i & 0xF];
+			text[i][2] = ' ';
+		}
+	}
+};
+
+static const HexTable hex_table;
+
+void hex_print(Output& out, const uint8_t* data, uint32_t length)
 {
 	for (uint32_t i = 0; i < length; )
 	{
-		fprintf(f, "%.2x ", data[i]);
+		out.write(hex_table.text[data[i]], 3);
 		if (++i % 4 == 0)
-			fputc(' ', f);
+			out.put(' ');
 	}
 }
 
 struct CharSet
 {
-	struct Block
+	struct Block		// Read in place, so only bytes
 	{
 		uint8_t character;
 		uint8_t unknown_0[48];
 
-		void read(FILE* f)
-		{
-			fread(&character, 1, sizeof(character), f);
-			fread(unknown_0, 1, sizeof(unknown_0), f);
-		}
-
-		void print(FILE* f) const
+		void print(Output& out, uint32_t number) const
 		{
-			fprintf(f, "character: %u [%#.2x]\n", character, character);
-			hex_print(f, unknown_0, sizeof(unknown_0));
-			fputc('\n', f);
+			out.write("============ block #");
+			out.number(number);
+			out.write(" ============\ncharacter: ");
+			out.number(character);
+			out.write(" [");
+			out.hex(character);
+			out.write("]\n");
+			hex_print(out, unknown_0, sizeof(unknown_0));
+			out.put('\n');
 		}
 	};
 
-	typedef std::list<Block> Blocks;
-
 	uint16_t version;		// [unsure]
 	uint32_t header_size;		// [unsure]
 	uint16_t unique_chars_no;	// [unsure] number of unique characters - 1
@@ -42,51 +68,163 @@ struct CharSet
 	uint16_t block_size;		// [unsure] block size - 1
 	uint32_t unknown_2;
 
-	Blocks blocks;
+	const Block* blocks;		// Pointing into the input
+	uint32_t blocks_no;
+	uint32_t trailing;		// Bytes after the last whole block
 
-	void read(FILE* f)
+	// Reads the header from HEADER_SIZE bytes of data
+	void read_header(const uint8_t* data)
 	{
-		fread(&version, 1, sizeof(version), f);
-		fread(&header_size, 1, sizeof(header_size), f);
-		fread(&unique_chars_no, 1, sizeof(unique_chars_no), f);
-		fread(&unknown_1, 1, sizeof(unknown_1), f);
-		fread(&block_size, 1, sizeof(block_size), f);
-		fread(&unknown_2, 1, sizeof(unknown_2), f);
-		Block block;
-		while (!feof(stdin))
-		{
-			block.read(f);
-			blocks.push_back(block);
-		}
+		memcpy(&version, data, sizeof(version));
+		memcpy(&header_size, data + 2, sizeof(header_size));
+		memcpy(&unique_chars_no, data + 6, sizeof(unique_chars_no));
+		memcpy(&unknown_1, data + 8, sizeof(unknown_1));
+		memcpy(&block_size, data + 10, sizeof(block_size));
+		memcpy(&unknown_2, data + 12, sizeof(unknown_2));
 	}
 
-	void print(FILE* f) const
+	bool read(const uint8_t* data, size_t size)
 	{
-		fprintf(f, "version: %u\n", version);
-		fprintf(f, "header size: %u\n", header_size);
-		fprintf(f, "unique charcters no.: %u\n", unique_chars_no + 1);
-		fprintf(f, "unknown 1: %u\n", unknown_1);
-		fprintf(f, "block size: %u\n", block_size + 1);
-		fprintf(f, "unknown 2: %u\n", unknown_2);
-		fprintf(f, "blocks no.: %u\n", (uint32_t) blocks.size());
-		uint32_t i = 0;
-		for (Blocks::const_iterator it = blocks.begin(); it != blocks.end(); ++it)
+		if (size < HEADER_SIZE)
+			return false;
+		read_header(data);
+		blocks = (const Block*) (data + HEADER_SIZE);
+		blocks_no = (size - HEADER_SIZE) / sizeof(Block);
+		trailing = (size - HEADER_SIZE) % sizeof(Block);
+		return true;
+	}
+
+	void print_header(Output& out) const
+	{
+		out.write("version: ");
+		out.number(version);
+		out.write("\nheader size: ");
+		out.number(header_size);
+		out.write("\nunique charcters no.: ");
+		out.number(unique_chars_no + 1);
+		out.write("\nunknown 1: ");
+		out.number(unknown_1);
+		out.write("\nblock size: ");
+		out.number(block_size + 1);
+		out.write("\nunknown 2: ");
+		out.number(unknown_2);
+		out.put('\n');
+	}
+
+	void print_count(Output& out) const
+	{
+		out.write("blocks no.: ");
+		out.number(blocks_no);
+		out.put('\n');
+	}
+
+	void print_trailing(Output& out) const
+	{
+		if (trailing)
 		{
-			fprintf(f, "============ block #%u ============\n", ++i);
-			it->print(f);
+			out.write("trailing bytes: ");
+			out.number(trailing);
+			out.put('\n');
 		}
 	}
+
+	void print(Output& out) const
+	{
+		print_header(out);
+		print_count(out);
+		for (uint32_t i = 0; i < blocks_no; ++i)
+			blocks[i].print(out, i + 1);
+		print_trailing(out);
+	}
+
+	// Prints blocks as they are read from fd, keeping only a few of them
+	// in memory.  The number of blocks is printed after them.
+	bool stream(int fd, Output& out);
 };
 
+static size_t read_fully(int fd, uint8_t* data, size_t size)
+{
+	size_t done = 0;
+	while (done < size)
+	{
+		ssize_t n = read(fd, data + done, size - done);
+		if (n <= 0)
+			break;
+		done += n;
+	}
+	return done;
+}
+
+bool CharSet::stream(int fd, Output& out)
+{
+	std::vector<uint8_t> buffer(STREAM_BLOCKS * sizeof(Block));
+	if (read_fully(fd, buffer.data(), HEADER_SIZE) < HEADER_SIZE)
+		return false;
+	read_header(buffer.data());
+	print_header(out);
+	blocks_no = 0;
+	size_t size;
+	do
+	{
+		size = read_fully(fd, buffer.data(), buffer.size());
+		blocks = (const Block*) buffer.data();
+		for (size_t i = 0; i < size / sizeof(Block); ++i)
+			blocks[i].print(out, ++blocks_no);
+	}
+	while (size == buffer.size());
+	trailing = size % sizeof(Block);
+	print_count(out);
+	print_trailing(out);
+	return true;
+}
+
 int main(int argc, const char* argv[])
 {
-	if (argc > 1 && freopen(argv[1], "r", stdin) == NULL)
+	bool streaming = argc > 1 && !strcmp(argv[1], "--stream");
+	int arg = 1 + streaming;
+	if (argc - arg > 1)
+	{
+		fputs("Usage: charset [--stream] [input-file]\n", stderr);
+		return 1;
+	}
+	int fd = 0;
+	if (arg < argc && (fd = open(argv[arg], O_RDONLY)) < 0)
 	{
 		fputs("Error: Failed to open input file\n", stderr);
 		return 1;
 	}
 	CharSet charset;
-	charset.read(stdin);
-	charset.print(stdout);
+	Output out(1);
+	bool ok;
+	struct stat st;
+	if (streaming)
+		ok = charset.stream(fd, out);
+	else if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+	{
+		void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		ok = addr != MAP_FAILED && charset.read((const uint8_t*) addr, st.st_size);
+		if (ok)
+			charset.print(out);
+	}
+	else		// A pipe, read whole
+	{
+		std::vector<uint8_t> data;
+		uint8_t buffer[1 << 16];
+		for (ssize_t n; (n = read(fd, buffer, sizeof(buffer))) > 0; )
+			data.insert(data.end(), buffer, buffer + n);
+		ok = charset.read(data.data(), data.size());
+		if (ok)
+			charset.print(out);
+	}
+	if (!ok)
+	{
+		fputs("Error: Failed to read input file\n", stderr);
+		return 1;
+	}
+	if (!out.flush())
+	{
+		fputs("Error: Failed to write output\n", stderr);
+		return 1;
+	}
 	return 0;
 }
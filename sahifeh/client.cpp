@@ -0,0 +1,81 @@
+// Sends a request to sahifehd and writes the answer to stdout.
+//
+// Usage: sahifeh-client [-s socket] request...
+//
+// The words of request are joined by spaces, as in
+// "sahifeh-client page 1 12 text".  See daemon.h for requests.
+
+#include <algorithm>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "daemon.h"
+
+int main(int argc, const char* argv[])
+{
+	const char* socket_path = SAHIFEHD_SOCKET;
+	int arg = 1;
+	if (arg + 1 < argc && !strcmp(argv[arg], "-s"))
+	{
+		socket_path = argv[arg + 1];
+		arg += 2;
+	}
+	if (arg == argc)
+	{
+		fputs("Usage: sahifeh-client [-s socket] request...\n", stderr);
+		return 1;
+	}
+	std::string request;
+	for (; arg < argc; ++arg)
+		request += std::string(argv[arg]) + (arg + 1 < argc ? " " : "\n");
+
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*) &address, sizeof(address)) != 0)
+	{
+		fputs("Error: Failed to connect to sahifehd\n", stderr);
+		return 1;
+	}
+	if (write(fd, request.data(), request.size()) != (ssize_t) request.size())
+	{
+		fputs("Error: Failed to send request\n", stderr);
+		return 1;
+	}
+	shutdown(fd, SHUT_WR);
+
+	// The status line, then as many bytes as it says
+	FILE* in = fdopen(fd, "rb");
+	char status[MAX_REQUEST_SIZE];
+	if (in == NULL || fgets(status, sizeof(status), in) == NULL)
+	{
+		fputs("Error: No answer from sahifehd\n", stderr);
+		return 1;
+	}
+	size_t size;
+	if (sscanf(status, "OK %zu", &size) != 1)
+	{
+		fprintf(stderr, "Error: %s", strncmp(status, "ERROR ", 6) ? status : status + 6);
+		return 1;
+	}
+	char buf[1 << 16];
+	while (size)
+	{
+		size_t got = fread(buf, 1, std::min(size, sizeof(buf)), in);
+		if (got == 0 || fwrite(buf, 1, got, stdout) != got)
+		{
+			fputs("Error: Answer is cut short\n", stderr);
+			return 1;
+		}
+		size -= got;
+	}
+	fclose(in);
+	return 0;
+}
@@ -0,0 +1,193 @@
+// Compiles codepage.txt into the glyph tables of the decoder.
+//
+// Usage: codepage_gen codepage.txt codepage.h
+
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <stdint.h>
+
+#include "glyph.h"
+
+struct Entry
+{
+	bool mapped;
+	char text[32];
+	unsigned size;
+	const char* joining;
+	const char* flags;		// Beyond GLYPH_KNOWN
+};
+
+static Entry table_fa[256];
+static Entry table_en[256];
+
+static const char* source;
+static unsigned line_no;
+
+static bool fail(const char* message)
+{
+	fprintf(stderr, "%s:%u: %s\n", source, line_no, message);
+	return false;
+}
+
+static int hex_value(char c)
+{
+	if ('0' <= c && c <= '9')
+		return c - '0';
+	if ('A' <= c && c <= 'F')
+		return c - 'A' + 10;
+	if ('a' <= c && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+// Parses a mapping line.  Lines that are not mappings are left alone.
+static bool parse_line(const char* line, Entry* table)
+{
+	if (hex_value(line[0]) < 0 || hex_value(line[1]) < 0 || (line[2] != ' ' && line[2] != '\t'))
+		return true;
+	const char* p = line + 2;
+	while (*p == ' ' || *p == '\t')
+		++p;
+	if (*p != '"')
+		return true;		// A note on an unmapped byte
+	Entry& entry = table[hex_value(line[0]) * 16 + hex_value(line[1])];
+	if (entry.mapped)
+		return fail("byte is mapped twice");
+	entry.mapped = true;
+	for (++p; *p != '"'; ++p)
+	{
+		if (!*p)
+			return fail("unterminated output string");
+		char c = *p;
+		if (c == '\\')
+			switch (*++p)
+			{
+				case 'n':
+					c = '\n';
+					break;
+				case 't':
+					c = '\t';
+					break;
+				case '"':
+				case '\\':
+					c = *p;
+					break;
+				case 'x':
+					if (hex_value(p[1]) < 0 || hex_value(p[2]) < 0)
+						return fail("bad \\x escape");
+					c = hex_value(p[1]) * 16 + hex_value(p[2]);
+					p += 2;
+					break;
+				default:
+					return fail("unknown escape");
+			}
+		if (entry.size + 1 >= sizeof(Glyph::text))		// Leave room for the NUL
+			return fail("output is too long");
+		entry.text[entry.size++] = c;
+	}
+	++p;
+	while (*p == ' ' || *p == '\t')
+		++p;
+	const char* flag = p;
+	while (*p && *p != ' ' && *p != '\t')
+		++p;
+	size_t flag_size = p - flag;
+	entry.joining = "JOINS_NONE";
+	entry.flags = "";
+	if (flag_size == 1 && *flag == '-')
+		;
+	else if (flag_size == 4 && !strncmp(flag, "prev", 4))
+		entry.joining = "JOINS_PREV";
+	else if (flag_size == 4 && !strncmp(flag, "next", 4))
+		entry.joining = "JOINS_NEXT";
+	else if (flag_size == 4 && !strncmp(flag, "both", 4))
+		entry.joining = "JOINS_BOTH";
+	else if (flag_size == 3 && !strncmp(flag, "ltr", 3))
+		entry.flags = " | GLYPH_LTR";
+	else if (flag_size == 5 && !strncmp(flag, "break", 5))
+		entry.flags = " | GLYPH_BREAK";
+	else if (flag_size == 3 && !strncmp(flag, "tab", 3))
+		entry.flags = " | GLYPH_TAB";
+	else
+		return fail("joining should be one of -, prev, next, both, ltr, break and tab");
+	return true;
+}
+
+static void write_table(FILE* f, const char* name, const Entry* table)
+{
+	fprintf(f, "static constexpr Glyph %s[256] =\n{\n", name);
+	for (int i = 0; i < 256; ++i)
+	{
+		const Entry& entry = table[i];
+		if (!entry.mapped)
+		{
+			fprintf(f, "\t{ \"\", 0, JOINS_NONE, 0 },\t\t// 0x%.2x\n", i);
+			continue;
+		}
+		fputs("\t{ \"", f);
+		for (unsigned j = 0; j < entry.size; ++j)
+		{
+			uint8_t c = entry.text[j];
+			if (c == '"' || c == '\\')
+				fprintf(f, "\\%c", c);
+			else if (c == '\n')
+				fputs("\\n", f);
+			else if (c == '\t')
+				fputs("\\t", f);
+			else if (isprint(c))
+				fputc(c, f);
+			else
+				fprintf(f, "\\%.3o", c);		// Octal, as it never swallows what follows
+		}
+		fprintf(f, "\", %u, %s, GLYPH_KNOWN%s },\t// 0x%.2x\n",
+				entry.size, entry.joining, entry.flags, i);
+	}
+	fputs("};\n", f);
+}
+
+int main(int argc, const char* argv[])
+{
+	if (argc != 3)
+	{
+		fputs("Usage: codepage_gen codepage.txt codepage.h\n", stderr);
+		return 1;
+	}
+	source = argv[1];
+	FILE* in = fopen(source, "r");
+	if (in == NULL)
+	{
+		fputs("Error: Failed to open input file\n", stderr);
+		return 1;
+	}
+	Entry* table = table_fa;
+	char line[1024];
+	while (fgets(line, sizeof(line), in))
+	{
+		++line_no;
+		line[strcspn(line, "\r\n")] = '\0';
+		if (!strcmp(line, "English"))
+			table = table_en;
+		else if (!parse_line(line, table))
+			return 1;
+	}
+	fclose(in);
+
+	FILE* out = fopen(argv[2], "w");
+	if (out == NULL)
+	{
+		fputs("Error: Failed to open output file\n", stderr);
+		return 1;
+	}
+	fputs("// Generated by codepage_gen from codepage.txt.  Do not edit.\n\n", out);
+	fputs("#include \"glyph.h\"\n\n", out);
+	write_table(out, "glyphs_fa", table_fa);
+	fputc('\n', out);
+	write_table(out, "glyphs_en", table_en);
+	if (fclose(out) != 0)
+	{
+		fputs("Error: Failed to write output file\n", stderr);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compress.h"
+
+#define COMPRESS_OUT_SIZE (1<<18)
+#define GZIP_WINDOW_BITS (15 + 16)		// With a gzip header and trailer
+#define GZIP_MEMORY_LEVEL 8
+#define ZSTD_LEVEL 3
+
+Compressor::Compressor(int fd, Compression compression)
+	: fd(fd), compression(compression), stream(NULL), out(new char[COMPRESS_OUT_SIZE]),
+	head(0), tail(0), done(false), error(false), writer_waiting(false), reader_waiting(false), filled(0)
+{
+	for (int i = 0; i < COMPRESS_BLOCKS; ++i)
+	{
+		blocks[i].data = new char[COMPRESS_BLOCK_SIZE];
+		blocks[i].size = 0;
+	}
+}
+
+Compressor::~Compressor()
+{
+	if (thread.joinable())
+		finish();
+#ifdef HAVE_ZLIB
+	if (stream && compression == COMPRESS_GZIP)
+	{
+		deflateEnd((z_stream*) stream);
+		delete (z_stream*) stream;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	if (stream && compression == COMPRESS_ZSTD)
+		ZSTD_freeCCtx((ZSTD_CCtx*) stream);
+#endif
+	for (int i = 0; i < COMPRESS_BLOCKS; ++i)
+		delete [] blocks[i].data;
+	delete [] out;
+}
+
+bool Compressor::supported(Compression compression)
+{
+	switch (compression)
+	{
+#ifdef HAVE_ZLIB
+		case COMPRESS_GZIP:
+			return true;
+#endif
+#ifdef HAVE_ZSTD
+		case COMPRESS_ZSTD:
+			return true;
+#endif
+		default:
+			return false;
+	}
+}
+
+bool Compressor::start()
+{
+#ifdef HAVE_ZLIB
+	if (compression == COMPRESS_GZIP)
+	{
+		z_stream* z = new z_stream();
+		if (deflateInit2(z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, GZIP_WINDOW_BITS, GZIP_MEMORY_LEVEL,
+				Z_DEFAULT_STRATEGY) == Z_OK)
+			stream = z;
+		else
+			delete z;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	if (compression == COMPRESS_ZSTD)
+	{
+		ZSTD_CCtx* cctx = ZSTD_createCCtx();
+		if (cctx && !ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, ZSTD_LEVEL)))
+			stream = cctx;
+		else
+			ZSTD_freeCCtx(cctx);
+	}
+#endif
+	if (stream == NULL)
+		return false;
+	thread = std::thread(&Compressor::run, this);
+	return true;
+}
+
+bool Compressor::write(const char* data, size_t size)
+{
+	while (size)
+	{
+		size_t at = head.load(std::memory_order_relaxed);
+		if (at - tail.load(std::memory_order_acquire) == COMPRESS_BLOCKS)		// Ring full
+		{
+			// The flag is set before tail is looked at again, and the
+			// compressor moves tail before it looks at the flag, so one of
+			// them sees the other
+			std::unique_lock<std::mutex> lock(mutex);
+			writer_waiting = true;
+			while (at - tail.load() == COMPRESS_BLOCKS && !error)
+				wake.wait(lock);
+			writer_waiting = false;
+			if (error)
+				return false;
+		}
+		Block& block = blocks[at % COMPRESS_BLOCKS];
+		size_t n = std::min(size, (size_t) COMPRESS_BLOCK_SIZE - filled);
+		memcpy(block.data + filled, data, n);
+		filled += n;
+		data += n;
+		size -= n;
+		if (filled == COMPRESS_BLOCK_SIZE)
+		{
+			block.size = filled;
+			filled = 0;
+			head.store(at + 1);
+			wake_up(reader_waiting);
+		}
+	}
+	return !error;
+}
+
+bool Compressor::finish()
+{
+	if (!thread.joinable())
+		return false;
+	if (filled)		// Its slot was free when filling started
+	{
+		size_t at = head.load(std::memory_order_relaxed);
+		blocks[at % COMPRESS_BLOCKS].size = filled;
+		filled = 0;
+		head.store(at + 1);
+	}
+	done.store(true);
+	wake_up(reader_waiting);
+	thread.join();
+	return !error;
+}
+
+void Compressor::run()
+{
+	for (size_t at = 0; ; ++at)
+	{
+		if (head.load(std::memory_order_acquire) == at)		// Ring empty
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			reader_waiting = true;
+			while (head.load() == at && !done)
+				wake.wait(lock);
+			reader_waiting = false;
+		}
+		if (head.load(std::memory_order_acquire) == at)		// Done, and all taken
+		{
+			if (!error && !compress(NULL, 0, true))
+				error = true;
+			return;
+		}
+		// After an error blocks are still taken, so that write() never
+		// waits for a full ring
+		const Block& block = blocks[at % COMPRESS_BLOCKS];
+		if (!error && !compress(block.data, block.size, false))
+			error = true;
+		tail.store(at + 1);
+		wake_up(writer_waiting);
+	}
+}
+
+void Compressor::wake_up(const std::atomic<bool>& waiting)
+{
+	if (waiting)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		wake.notify_all();
+	}
+}
+
+bool Compressor::compress(const char* data, size_t size, bool last)
+{
+#ifdef HAVE_ZLIB
+	if (compression == COMPRESS_GZIP)
+	{
+		z_stream* z = (z_stream*) stream;
+		z->next_in = (Bytef*) data;
+		z->avail_in = size;
+		do
+		{
+			z->next_out = (Bytef*) out;
+			z->avail_out = COMPRESS_OUT_SIZE;
+			if (deflate(z, last ? Z_FINISH : Z_NO_FLUSH) == Z_STREAM_ERROR
+					|| !write_out(out, COMPRESS_OUT_SIZE - z->avail_out))
+				return false;
+		}
+		while (z->avail_out == 0);
+		return true;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	if (compression == COMPRESS_ZSTD)
+	{
+		ZSTD_inBuffer in = { data, size, 0 };
+		for (;;)
+		{
+			ZSTD_outBuffer compressed = { out, COMPRESS_OUT_SIZE, 0 };
+			size_t left = ZSTD_compressStream2((ZSTD_CCtx*) stream, &compressed, &in, last ? ZSTD_e_end : ZSTD_e_continue);
+			if (ZSTD_isError(left) || !write_out(out, compressed.pos))
+				return false;
+			if (last ? left == 0 : in.pos == in.size)
+				return true;
+		}
+	}
+#endif
+	return false;
+}
+
+bool Compressor::write_out(const char* data, size_t size)
+{
+	while (size)
+	{
+		ssize_t written = ::write(fd, data, size);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		data += written;
+		size -= written;
+	}
+	return true;
+}
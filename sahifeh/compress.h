@@ -0,0 +1,71 @@
+#ifndef SAHIFEH_COMPRESS_H
+#define SAHIFEH_COMPRESS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <stddef.h>
+
+#include "output.h"
+
+#define COMPRESS_BLOCKS 8				// In the ring
+#define COMPRESS_BLOCK_SIZE (1<<20)
+
+enum Compression
+{
+	COMPRESS_GZIP,
+	COMPRESS_ZSTD,
+};
+
+// Compresses what is written to it on a thread of its own, and writes the
+// result to fd.  Blocks of input pass through a ring with one writer and
+// one reader, so neither side takes a lock while there is room, and data;
+// the writer only waits when the whole ring is waiting to be compressed,
+// and the compressor when it is empty.  A side that waits sleeps on a
+// condition variable, and the other wakes it once it has moved on.
+class Compressor : public OutputSink
+{
+public:
+	Compressor(int fd, Compression compression);
+	virtual ~Compressor();
+
+	static bool supported(Compression compression);		// In this build
+
+	bool start();
+	virtual bool write(const char* data, size_t size);
+	bool finish();		// Compresses what is left, and waits for it
+
+private:
+	Compressor(const Compressor&);
+	Compressor& operator=(const Compressor&);
+
+	struct Block
+	{
+		char* data;
+		size_t size;
+	};
+
+	void run();
+	void wake_up(const std::atomic<bool>& waiting);		// The other side, if it sleeps
+	bool compress(const char* data, size_t size, bool last);
+	bool write_out(const char* data, size_t size);
+
+	int fd;
+	Compression compression;
+	void* stream;		// Of the compression library
+	char* out;			// Compressed, before it is written
+	Block blocks[COMPRESS_BLOCKS];
+	std::atomic<size_t> head;		// Blocks filled so far
+	std::atomic<size_t> tail;		// Blocks compressed so far
+	std::atomic<bool> done;			// When no more blocks come
+	std::atomic<bool> error;
+	std::atomic<bool> writer_waiting;		// For room in a full ring
+	std::atomic<bool> reader_waiting;		// For a block, or the end
+	std::mutex mutex;		// Of the waits only
+	std::condition_variable wake;
+	size_t filled;		// Of the block at head
+	std::thread thread;
+};
+
+#endif
@@ -0,0 +1,423 @@
+// Serves decoded pages of a Cdf file over a Unix domain socket.
+//
+// Usage: sahifehd [-j workers] [-s socket] [-m megabytes] input-file
+//
+// Pages are decoded when first asked for, and the most recently used ones
+// are kept in a PageCache of at most -m megabytes, so that a popular page
+// costs a lookup and a copy.  Text by span is collected once at start, for
+// span requests to search it.  Idle connections cost no worker: workers
+// take requests as they come, from any connection.  See daemon.h for the
+// protocol.
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "daemon.h"
+#include "decoder.h"
+#include "page_cache.h"
+#include "page_index.h"
+
+#define DEFAULT_CACHE_MB 256
+#define ACCEPT_BACKOFF_MS 100
+#define SEND_TIMEOUT 10		// Seconds
+
+struct Segment		// Text of one span
+{
+	uint8_t format;
+	std::string text;
+};
+
+// Collects the text of a page by span
+class SegmentWriter : public Handler
+{
+public:
+	explicit SegmentWriter(std::vector<Segment>& segments) : segments(segments), in_segment(false) { }
+
+	virtual void begin(const DecoderState& state) { spans = state; }
+	virtual void span_open(uint8_t format) { in_segment = false; spans.open(format); }
+	virtual void span_close()
+	{
+		in_segment = false;
+		if (spans.span > 0)
+			--spans.span;
+	}
+	virtual void text(const char* text, size_t size) { append(text, size); }
+	virtual void ltr(const char* text, size_t size) { append(text, size); }
+	virtual void line_break() { append("\n", 1); }
+	virtual void tab() { append("\t", 1); }
+	virtual void footnote_rule() { in_segment = false; }
+
+private:
+	void append(const char* text, size_t size)
+	{
+		if (!spans.span)
+			return;
+		if (!in_segment)
+		{
+			Segment segment = { spans.format(), std::string() };
+			segments.push_back(segment);
+			in_segment = true;
+		}
+		segments.back().text.append(text, size);
+	}
+
+	std::vector<Segment>& segments;
+	DecoderState spans;
+	bool in_segment;
+};
+
+struct Page
+{
+	unsigned volume;
+	unsigned page;
+	std::vector<Segment> segments;
+};
+
+// Text of all pages by span.  Nothing changes once it is loaded, so workers read
+// it without locks.
+class PageStore
+{
+public:
+	void load(const uint8_t* data, size_t size, const std::vector<PageMark>& marks, unsigned jobs);
+
+	const std::vector<Page>& all() const { return pages; }
+
+private:
+	std::vector<Page> pages;		// In input order
+};
+
+void PageStore::load(const uint8_t* data, size_t size, const std::vector<PageMark>& marks, unsigned jobs)
+{
+	pages.resize(marks.size());
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < jobs; ++i)
+		threads.push_back(std::thread([&]()
+		{
+			for (size_t i; (i = next++) < marks.size(); )
+			{
+				const uint8_t* begin = data + marks[i].offset;
+				const uint8_t* end = i + 1 < marks.size() ? data + marks[i + 1].offset : data + size;
+				Page& page = pages[i];
+				page.volume = marks[i].volume;
+				page.page = marks[i].page;
+				SegmentWriter writer(page.segments);
+				Decoder decoder(writer, marks[i].state());
+				decoder.decode(begin, end, data + size, begin - data);
+				decoder.finish();
+			}
+		}));
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+}
+
+static bool write_all(int fd, const char* data, size_t size)
+{
+	while (size)
+	{
+		ssize_t written = write(fd, data, size);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+static bool reply(int fd, const std::vector<const std::string*>& parts)
+{
+	size_t size = 0;
+	for (size_t i = 0; i < parts.size(); ++i)
+		size += parts[i]->size();
+	char header[32];
+	int header_size = snprintf(header, sizeof(header), "OK %zu\n", size);
+	if (!write_all(fd, header, header_size))
+		return false;
+	for (size_t i = 0; i < parts.size(); ++i)
+		if (!write_all(fd, parts[i]->data(), parts[i]->size()))
+			return false;
+	return true;
+}
+
+static bool reply_error(int fd, const char* message)
+{
+	std::string line = std::string("ERROR ") + message + "\n";
+	return write_all(fd, line.data(), line.size());
+}
+
+static int find_format(const char* name)
+{
+	for (int format = 0; format < 16; ++format)
+		if (span_class(format) && !strcmp(span_class(format), name))
+			return format;
+	return -1;
+}
+
+static bool answer(int fd, const PageStore& store, PageCache& cache, const char* request)
+{
+	unsigned volume, first, last;
+	char kind[16], name[32];
+	int used = 0;
+	std::vector<const std::string*> parts;
+	std::string spans;
+	if (!strcmp(request, "stats"))
+	{
+		char line[128];
+		snprintf(line, sizeof(line), "hits %llu\nmisses %llu\nbytes %zu\ncapacity %zu\n",
+			(unsigned long long) cache.hits(), (unsigned long long) cache.misses(), cache.size(), cache.capacity());
+		spans = line;
+		parts.push_back(&spans);
+		return reply(fd, parts);
+	}
+	else if (sscanf(request, "page %u %u %15s %n", &volume, &first, kind, &used) == 3 && !request[used])
+		last = first;
+	else if (sscanf(request, "pages %u %u %u %15s %n", &volume, &first, &last, kind, &used) == 4 && !request[used])
+		;
+	else if (sscanf(request, "span %u %31s %n", &volume, name, &used) == 2 && !request[used])
+	{
+		if (volume > 0xFF)
+			return reply_error(fd, "no such volume");
+		int format = find_format(name);
+		if (format < 0)
+			return reply_error(fd, "unknown span class");
+		const std::vector<Page>& pages = store.all();
+		for (size_t i = 0; i < pages.size(); ++i)
+			if (pages[i].volume == volume)
+				for (size_t j = 0; j < pages[i].segments.size(); ++j)
+					if (pages[i].segments[j].format == format)
+					{
+						spans += pages[i].segments[j].text;
+						spans += '\n';
+					}
+		parts.push_back(&spans);
+		return reply(fd, parts);
+	}
+	else
+		return reply_error(fd, "bad request");
+
+	if (volume > 0xFF || first > 0xFFFF)		// Numbers are a byte and two in Cdf
+		return reply_error(fd, "no such pages");
+	bool html = !strcmp(kind, "html");
+	if (!html && strcmp(kind, "text"))
+		return reply_error(fd, "format should be html or text");
+	std::vector<std::string> found;
+	std::string output;
+	for (unsigned page = first; page <= last && page <= 0xFFFF; ++page)
+		if (cache.get(volume, page, html ? FORMAT_HTML : FORMAT_TEXT, output))
+			found.push_back(output);
+	if (found.empty())
+		return reply_error(fd, "no such pages");
+	for (size_t i = 0; i < found.size(); ++i)
+		parts.push_back(&found[i]);
+	return reply(fd, parts);
+}
+
+struct Connection
+{
+	int fd;
+	size_t size;		// Of the request begun in buf
+	char buf[MAX_REQUEST_SIZE];
+};
+
+// Reads what the client has sent so far, and answers the whole requests in
+// it.  Returns false when the connection should be closed.
+static bool serve(Connection& connection, const PageStore& store, PageCache& cache)
+{
+	char* buf = connection.buf;
+	size_t& size = connection.size;
+	for (;;)
+	{
+		ssize_t got = recv(connection.fd, buf + size, sizeof(connection.buf) - size, MSG_DONTWAIT);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return true;
+		if (got <= 0)
+			return false;
+		size += got;
+		char* line = buf;
+		for (char* newline; (newline = (char*) memchr(line, '\n', buf + size - line)); line = newline + 1)
+		{
+			*newline = '\0';
+			if (newline > line && newline[-1] == '\r')
+				newline[-1] = '\0';
+			if (!answer(connection.fd, store, cache, line))
+				return false;
+		}
+		size -= line - buf;
+		memmove(buf, line, size);
+		if (size == sizeof(connection.buf))
+		{
+			reply_error(connection.fd, "request is too long");
+			return false;
+		}
+	}
+}
+
+// Takes the connections waiting on listener, and has poller watch them
+static void accept_all(int listener, int poller)
+{
+	for (;;)
+	{
+		int fd = accept(listener, NULL, NULL);
+		if (fd < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				// Like running out of descriptors, which lasts a while
+				fprintf(stderr, "Error: Failed to accept a connection: %s\n", strerror(errno));
+				usleep(ACCEPT_BACKOFF_MS * 1000);
+			}
+			return;
+		}
+		// A client that stops reading holds up its worker for a while at most
+		struct timeval timeout = { SEND_TIMEOUT, 0 };
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		Connection* connection = new Connection;
+		connection->fd = fd;
+		connection->size = 0;
+		struct epoll_event event;
+		event.events = EPOLLIN | EPOLLONESHOT;
+		event.data.ptr = connection;
+		if (epoll_ctl(poller, EPOLL_CTL_ADD, fd, &event) != 0)
+		{
+			close(fd);
+			delete connection;
+		}
+	}
+}
+
+static void usage()
+{
+	fputs("Usage: sahifehd [-j workers] [-s socket] [-m megabytes] input-file\n", stderr);
+}
+
+int main(int argc, const char* argv[])
+{
+	unsigned jobs = std::max(std::thread::hardware_concurrency(), 1u);
+	const char* socket_path = SAHIFEHD_SOCKET;
+	size_t cache_size = (size_t) DEFAULT_CACHE_MB << 20;
+	int arg = 1;
+	for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+	{
+		if (!strcmp(argv[arg], "-j") && atoi(argv[arg + 1]) >= 1)
+			jobs = atoi(argv[arg + 1]);
+		else if (!strcmp(argv[arg], "-s"))
+			socket_path = argv[arg + 1];
+		else if (!strcmp(argv[arg], "-m") && atoi(argv[arg + 1]) >= 1)
+			cache_size = (size_t) atoi(argv[arg + 1]) << 20;
+		else
+			break;
+	}
+	if (argc - arg != 1)
+	{
+		usage();
+		return 1;
+	}
+	int fd = open(argv[arg], O_RDONLY);
+	if (fd < 0)
+	{
+		fputs("Error: Failed to open input file\n", stderr);
+		return 1;
+	}
+	struct stat st;
+	void* addr = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+		addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+	{
+		fputs("Error: Failed to map input file\n", stderr);
+		return 1;
+	}
+
+	const uint8_t* data = (const uint8_t*) addr;
+	std::vector<PageMark> marks;
+	load_page_index(argv[arg], data, st.st_size, marks);
+	PageStore store;
+	store.load(data, st.st_size, marks, jobs);
+	PageCache cache(data, st.st_size, marks, cache_size);		// Keeping the file mapped
+
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(address.sun_path))
+	{
+		fputs("Error: Socket path is too long\n", stderr);
+		return 1;
+	}
+	strcpy(address.sun_path, socket_path);
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(socket_path);
+	if (listener < 0 || bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(listener, 128) != 0)
+	{
+		fputs("Error: Failed to listen on socket\n", stderr);
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	// Workers wait on the listener and on every connection at once, and each
+	// event goes to one of them, so that a worker is busy only while there
+	// are requests to answer, however many clients sit idle.  Each of these
+	// is armed for one event, and armed again once it has been handled.
+	int poller = epoll_create1(0);
+	struct epoll_event event;
+	event.events = EPOLLIN | EPOLLONESHOT;
+	event.data.ptr = NULL;		// The listener
+	if (poller < 0 || fcntl(listener, F_SETFL, O_NONBLOCK) != 0
+			|| epoll_ctl(poller, EPOLL_CTL_ADD, listener, &event) != 0)
+	{
+		fputs("Error: Failed to listen on socket\n", stderr);
+		return 1;
+	}
+	std::vector<std::thread> workers;
+	for (unsigned i = 0; i < jobs; ++i)
+		workers.push_back(std::thread([&]()
+		{
+			for (;;)
+			{
+				struct epoll_event event;
+				if (epoll_wait(poller, &event, 1, -1) != 1)
+					continue;
+				Connection* connection = (Connection*) event.data.ptr;
+				int fd = connection ? connection->fd : listener;
+				if (!connection)
+					accept_all(listener, poller);
+				else if (!serve(*connection, store, cache))
+				{
+					close(fd);
+					delete connection;
+					continue;
+				}
+				event.events = EPOLLIN | EPOLLONESHOT;
+				if (epoll_ctl(poller, EPOLL_CTL_MOD, fd, &event) != 0 && connection)
+				{
+					close(fd);
+					delete connection;
+				}
+			}
+		}));
+	for (size_t i = 0; i < workers.size(); ++i)
+		workers[i].join();
+	return 0;
+}
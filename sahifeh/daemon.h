@@ -0,0 +1,17 @@
+#ifndef SAHIFEH_DAEMON_H
+#define SAHIFEH_DAEMON_H
+
+// sahifehd protocol.  Requests are lines of text:
+//
+//	page V P html|text		A page
+//	pages V A B html|text	Pages A to B of volume V
+//	span V CLASS			Text of spans of CLASS (like aya) in volume V
+//	stats					Hits and misses of the page cache, and its size
+//
+// and each is answered with "OK size\n" followed by size bytes, or with
+// "ERROR message\n".  A connection may carry any number of requests.
+
+#define SAHIFEHD_SOCKET "/tmp/sahifehd.socket"
+#define MAX_REQUEST_SIZE 256
+
+#endif
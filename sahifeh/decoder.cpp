@@ -0,0 +1,338 @@
+#include <algorithm>
+#include <cstring>
+
+#include "codepage.h"
+#include "decoder.h"
+#include "hash.h"
+#include "scanner.h"
+
+#define NEW_PAGE 0x000182
+#define ENGLISH_START 0x020181
+#define ENGLISH_END 0x01007A
+#define ZWNJ "\xE2\x80\x8C"
+
+enum Step		// What a control byte may start
+{
+	STEP_GLYPH,
+	STEP_PAGE,
+	STEP_ENGLISH_START,
+	STEP_ENGLISH_END,
+	STEP_OPEN,
+	STEP_CLOSE,
+	STEP_RULE,
+};
+
+static const uint8_t control_steps[CONTROL_LAST - CONTROL_FIRST + 1] =		// By control byte
+{
+	STEP_ENGLISH_END,		// 0x7A
+	STEP_GLYPH,
+	STEP_GLYPH,
+	STEP_OPEN,				// 0x7D
+	STEP_OPEN,				// 0x7E
+	STEP_GLYPH,
+	STEP_CLOSE,				// 0x80
+	STEP_ENGLISH_START,		// 0x81
+	STEP_PAGE,				// 0x82
+	STEP_GLYPH,
+	STEP_GLYPH,
+	STEP_RULE,				// 0x85
+};
+
+// Whether data starts with signature, and size bytes of its step are there
+static inline bool at_signature(const uint8_t* data, const uint8_t* end, uint32_t signature, ptrdiff_t size)
+{
+	return end - data >= size && (data[0] | data[1] << 8 | (uint32_t) data[2] << 16) == signature;
+}
+
+static const char* const span_classes[16] =		// By format code
+{
+	NULL,
+	"title",				// عنوان
+	NULL,
+	"hadith",				// حدیث
+	"aya",					// آیه
+	"poem",					// شعر
+	NULL,
+	NULL,
+	"comment",				// ترجمه
+	NULL,
+	NULL,
+	"footnote",				// پاورقی
+	"footnote_aya",			// آیه در پاورقی
+	"footnote_hadith",		// حدیث در پاورقی
+	"footnote_poem",		// شعر در پاورقی
+	"footnote_comment",		// توضیح در پاورقی
+};
+
+const char* span_class(uint8_t format)
+{
+	return format < 16 ? span_classes[format] : NULL;
+}
+
+Decoder::Decoder(Handler& handler, const DecoderState& state, DecodeStats* stats)
+	: handler(handler), state_(state), prev_joining(JOINS_NONE), origin(NULL), stats(stats),
+	english_start(NO_OFFSET), text_size(0)
+{
+	handler.begin(state);
+}
+
+void Decoder::finish()
+{
+	flush_text();
+	flush_ltr();
+	handler.end();
+}
+
+void Decoder::flush_text()
+{
+	if (text_size)
+	{
+		handler.text(text, text_size);
+		text_size = 0;
+	}
+}
+
+void Decoder::flush_ltr()
+{
+	if (ltr_run.empty())
+		return;
+	flush_text();
+	ltr_text.clear();
+	for (size_t i = ltr_run.size(); i-- > 0; )
+		ltr_text.insert(ltr_text.end(), ltr_run[i].data, ltr_run[i].data + ltr_run[i].size);
+	ltr_run.clear();
+	handler.ltr(ltr_text.data(), ltr_text.size());
+}
+
+inline void Decoder::put_glyph(const Glyph* table, const uint8_t* at)
+{
+	const Glyph& glyph = table[*at];
+	if (glyph.flags != GLYPH_KNOWN)
+	{
+		put_special(glyph, at);
+		return;
+	}
+	// Plain right-to-left text
+	CharJoining my_joining = (CharJoining) glyph.joining;
+	if (glyph.size)
+	{
+		if (!ltr_run.empty())
+			flush_ltr();
+		if (text_size > sizeof(text) - sizeof(glyph.text) - (sizeof(ZWNJ) - 1))
+			flush_text();
+		if ((prev_joining & JOINS_NEXT) && (my_joining & JOINS_PREV))
+		{
+			memcpy(text + text_size, ZWNJ, sizeof(ZWNJ) - 1);
+			text_size += sizeof(ZWNJ) - 1;
+		}
+		memcpy(text + text_size, glyph.text, sizeof(glyph.text));		// Fixed size is cheaper
+		text_size += glyph.size;
+	}
+	prev_joining = my_joining;
+}
+
+void Decoder::put_special(const Glyph& glyph, const uint8_t* at)
+{
+	if (glyph.flags & GLYPH_LTR)
+	{
+		LtrSpan ltr = { glyph.text, glyph.size };
+		ltr_run.push_back(ltr);
+	}
+	else if (glyph.flags & (GLYPH_BREAK | GLYPH_TAB))
+	{
+		flush_ltr();
+		flush_text();
+		if (glyph.flags & GLYPH_BREAK)
+			handler.line_break();
+		else
+			handler.tab();
+	}
+	else if (!(glyph.flags & GLYPH_KNOWN))
+	{
+		flush_text();
+		if (stats)
+			stats->unknown_byte(*at, at - origin);
+		handler.unknown_byte(*at, at - origin);
+	}
+	prev_joining = (CharJoining) glyph.joining;
+}
+
+void Decoder::count_span(uint8_t format, const uint8_t* at)
+{
+	stats->max_span = std::max(stats->max_span, state_.span);
+	if (!span_class(format))
+		stats->unknown_format(format, at - origin);
+}
+
+const uint8_t* Decoder::decode(const uint8_t* data, const uint8_t* stop, const uint8_t* end, uint64_t offset)
+{
+	origin = data - offset;
+	const uint8_t* const begin = data;
+	if (english_start == NO_OFFSET)		// A run open before the input starts with it
+		english_start = offset;
+	while (data < stop)		// A loop of each mode in turn, switching at English runs
+		data = state_.english ? decode_mode<true>(data, stop, end) : decode_mode<false>(data, stop, end);
+	if (stats)
+		for (const uint8_t* at = begin; at < data; ++at)
+			++stats->bytes[*at];
+	return data;
+}
+
+template <bool English>
+const uint8_t* Decoder::decode_mode(const uint8_t* data, const uint8_t* stop, const uint8_t* end)
+{
+	const Glyph* const table = English ? glyphs_en : glyphs_fa;
+	int& span = state_.span;		// Opened through state_.open()
+	while (data < stop)
+	{
+		// Plain glyphs up to the next control byte need nothing but a table
+		// lookup, and can neither start a signature nor change the mode
+		const uint8_t* control = find_control(data, stop);
+		if (control != data)
+		{
+			for (; data < control; ++data)
+				put_glyph(table, data);
+			continue;
+		}
+
+		// Each control byte starts a step of its own, which it alone decides
+		switch (control_steps[*data - CONTROL_FIRST])
+		{
+			case STEP_PAGE:
+				if (!at_signature(data, end, NEW_PAGE, 6))
+					break;
+				{
+					uint8_t volume = data[3];
+					uint16_t page = data[4] | data[5] << 8;
+					flush_ltr();
+					flush_text();
+					if (stats)
+					{
+						++stats->pages;
+						++stats->volume_pages[volume];
+					}
+					handler.page(volume, page);
+				}
+				data += 6;
+				prev_joining = JOINS_NONE;
+				continue;
+			case STEP_ENGLISH_START:
+				if (!at_signature(data, end, ENGLISH_START, 3))
+					break;
+				data += 3;
+				english_start = data - origin;
+				prev_joining = JOINS_NONE;
+				if (English)
+					continue;
+				state_.english = true;
+				return data;
+			case STEP_ENGLISH_END:
+				if (!at_signature(data, end, ENGLISH_END, 3))
+					break;
+				if (stats && English)
+					stats->english_run(data - origin - english_start);
+				data += 3;
+				prev_joining = JOINS_NONE;
+				if (!English)
+					continue;
+				state_.english = false;
+				return data;
+			case STEP_OPEN:		// آغاز یک بخش؟ تعیین رنگ و قلم؟
+				if (end - data < 2)		// Truncated at end of input
+				{
+					++data;
+					continue;
+				}
+				flush_text();
+				handler.span_open(data[1]);
+				state_.open(data[1]);
+				if (stats)
+					count_span(data[1], data);
+				prev_joining = JOINS_NONE;
+				data += 2;
+				continue;
+			case STEP_CLOSE:		// اتمام یک بخش؟
+				if (span > 0)
+				{
+					flush_text();
+					handler.span_close();
+					--span;
+				}
+				else if (stats)
+					++stats->unbalanced_closes;
+				prev_joining = JOINS_NONE;
+				++data;
+				continue;
+			case STEP_RULE:		// خط افقی (برای جدا کردن پاورقی)
+				flush_text();
+				handler.footnote_rule();
+				prev_joining = JOINS_NONE;
+				++data;
+				continue;
+			default:
+				break;
+		}
+		put_glyph(table, data);		// Not a step after all
+		++data;
+	}
+	return data;
+}
+
+uint64_t decoder_version()
+{
+	return hash_bytes(glyphs_en, sizeof(glyphs_en), hash_bytes(glyphs_fa, sizeof(glyphs_fa), DECODER_VERSION));
+}
+
+void scan_pages(const uint8_t* data, const uint8_t* end, std::vector<PageMark>& pages)
+{
+	const uint8_t* const begin = data;
+	DecoderState state;
+	bool& english = state.english;
+	int& span = state.span;
+	while ((data = find_control(data, end)) < end)
+	{
+		switch (control_steps[*data - CONTROL_FIRST])
+		{
+			case STEP_PAGE:
+				if (!at_signature(data, end, NEW_PAGE, 6))
+					break;
+				{
+					PageMark mark;
+					mark.offset = data - begin;
+					mark.volume = data[3];
+					mark.page = data[4] | data[5] << 8;
+					mark.english = english;
+					mark.span = span;
+					memcpy(mark.formats, state.formats, sizeof(mark.formats));
+					pages.push_back(mark);
+				}
+				data += 6;
+				continue;
+			case STEP_ENGLISH_START:
+				if (!at_signature(data, end, ENGLISH_START, 3))
+					break;
+				data += 3;
+				english = true;
+				continue;
+			case STEP_ENGLISH_END:
+				if (!at_signature(data, end, ENGLISH_END, 3))
+					break;
+				data += 3;
+				english = false;
+				continue;
+			case STEP_OPEN:
+				if (end - data < 2)
+					break;
+				state.open(data[1]);
+				data += 2;
+				continue;
+			case STEP_CLOSE:
+				if (span > 0)
+					--span;
+				break;
+			default:
+				break;
+		}
+		++data;
+	}
+}
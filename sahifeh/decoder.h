@@ -0,0 +1,144 @@
+#ifndef SAHIFEH_DECODER_H
+#define SAHIFEH_DECODER_H
+
+#include <vector>
+#include <cstring>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "glyph.h"
+#include "stats.h"
+
+#define MAX_STEP 6		// Bytes of the longest step, a page signature
+#define TEXT_BUFFER_SIZE 4096
+#define DECODER_VERSION 2		// Bumped whenever the same input decodes differently
+#define SPAN_STACK_SIZE 8		// Open spans whose format is remembered
+
+struct DecoderState		// What carries over from one page to the next
+{
+	bool english;
+	int span;		// Depth of open spans
+	uint8_t formats[SPAN_STACK_SIZE];	// Of the innermost open spans, by depth
+
+	DecoderState() : english(false), span(0)
+	{
+		memset(formats, 0, sizeof(formats));
+	}
+
+	void open(uint8_t format)
+	{
+		formats[span++ % SPAN_STACK_SIZE] = format;
+	}
+
+	uint8_t format() const		// Of the innermost open span, if any
+	{
+		return span > 0 ? formats[(span - 1) % SPAN_STACK_SIZE] : 0;
+	}
+};
+
+struct PageMark		// A page signature, and the decoder state before it
+{
+	size_t offset;
+	uint8_t volume;
+	uint16_t page;
+	bool english;
+	int span;
+	uint8_t formats[SPAN_STACK_SIZE];
+
+	DecoderState state() const
+	{
+		DecoderState state;
+		state.english = english;
+		state.span = span;
+		memcpy(state.formats, formats, sizeof(formats));
+		return state;
+	}
+};
+
+// Receives what the decoder finds, in input order.  Text passed to it lives
+// in the decoder or in its tables, and is only valid during the call.
+class Handler
+{
+public:
+	virtual ~Handler() { }
+
+	virtual void begin(const DecoderState& state) { }	// Spans open before the input
+	virtual void end() { }		// After everything of the input
+	virtual void page(unsigned volume, unsigned page) { }
+	virtual void span_open(uint8_t format) { }		// See span_class()
+	virtual void span_close() { }
+	virtual void text(const char* text, size_t size) { }	// Right to left UTF-8
+	virtual void ltr(const char* text, size_t size) { }		// A number or English run
+	virtual void line_break() { }
+	virtual void tab() { }
+	virtual void footnote_rule() { }
+	virtual void unknown_byte(uint8_t byte, uint64_t offset) { }
+};
+
+// CSS class of a span format code, like "aya" or "footnote_aya", or NULL
+const char* span_class(uint8_t format);
+
+// Turns Cdf bytes into Handler events.  A decoder holds the state of one
+// input, so concurrent inputs each need their own.  With stats, it also
+// counts what it decodes there; decoders on other threads need other stats.
+class Decoder
+{
+public:
+	explicit Decoder(Handler& handler, const DecoderState& state = DecoderState(), DecodeStats* stats = NULL);
+
+	// Decodes every step that starts before stop, looking ahead no further
+	// than end, and returns where it stopped.  A step may run past stop, but
+	// never past end.  A chunk of a stream is decoded with stop a few bytes
+	// short of end, so that signatures and format pairs split between chunks
+	// are left for the next chunk.  offset is the position of data in the
+	// input, as reported with unknown bytes.
+	const uint8_t* decode(const uint8_t* data, const uint8_t* stop, const uint8_t* end, uint64_t offset = 0);
+
+	// Passes on text and a number or English run still held back, and ends
+	// the input
+	void finish();
+
+	const DecoderState& state() const { return state_; }
+
+private:
+	Decoder(const Decoder&);
+	Decoder& operator=(const Decoder&);
+
+	struct LtrSpan		// A glyph of a left-to-right run, pointing into a table
+	{
+		const char* data;
+		uint16_t size;
+	};
+
+	// Decodes in one mode, with its own glyph table, up to stop or to where
+	// the mode changes
+	template <bool English>
+	const uint8_t* decode_mode(const uint8_t* data, const uint8_t* stop, const uint8_t* end);
+
+	void put_glyph(const Glyph* table, const uint8_t* at);
+	void put_special(const Glyph& glyph, const uint8_t* at);
+	void flush_text();
+	void flush_ltr();
+	void count_span(uint8_t format, const uint8_t* at);
+
+	Handler& handler;
+	DecoderState state_;
+	CharJoining prev_joining;
+	const uint8_t* origin;		// Where offset 0 of the input would be
+	DecodeStats* stats;
+	uint64_t english_start;		// Offset of the English run, with stats
+	size_t text_size;
+	char text[TEXT_BUFFER_SIZE];
+	std::vector<LtrSpan> ltr_run;	// Numbers and English parts, kept reversed
+	std::vector<char> ltr_text;
+};
+
+// DECODER_VERSION combined with the glyph tables, so that editing
+// codepage.txt changes it too
+uint64_t decoder_version();
+
+// Finds the page signatures that Decoder sees, along with the state it has
+// there.  It must step through data exactly as Decoder::decode() does.
+void scan_pages(const uint8_t* data, const uint8_t* end, std::vector<PageMark>& pages);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef SAHIFEH_GLYPH_H
+#define SAHIFEH_GLYPH_H
+
+#include <stdint.h>
+
+enum CharJoining		// What a char does while it shouldn't
+{
+	JOINS_NONE = 0,		// Leave it alone. It doesn't join badly.
+	JOINS_PREV = 1,		// If previous has JOINS_NEXT, it accepts
+	JOINS_NEXT = 2,		// Tries to join the next character, while it shouldn't
+	JOINS_BOTH = JOINS_PREV | JOINS_NEXT,
+};
+
+enum GlyphFlags
+{
+	GLYPH_KNOWN = 1,	// Mapped in codepage.txt, possibly to nothing
+	GLYPH_LTR = 2,		// Written left to right: numbers and English
+	GLYPH_BREAK = 4,	// Ends a line
+	GLYPH_TAB = 8,
+};
+
+// One decoded byte.  Entries are 32 bytes and aligned to that, so looking a
+// byte up touches a single cache line.
+struct alignas(32) Glyph
+{
+	char text[28];		// UTF-8, size bytes of it are used
+	uint8_t size;
+	uint8_t joining;	// CharJoining
+	uint8_t flags;		// GlyphFlags
+};
+
+#endif
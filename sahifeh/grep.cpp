@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <map>
+
+#include "codepage.h"
+#include "grep.h"
+
+#define ZWNJ "\xE2\x80\x8C"
+
+struct NfaEdge
+{
+	uint8_t byte;
+	uint32_t to;
+};
+
+// Byte sequences that decode to a text, as an NFA over its positions.  A
+// right-to-left glyph takes the text from position p to p + its size.  A run
+// of left-to-right glyphs, numbers and English, is stored last glyph first,
+// so the run that covers a to b is taken from b back to a, and only then
+// does the text go on from b.  Runs are whole, as the decoder makes them:
+// one never follows another.
+class EncodingNfa
+{
+public:
+	EncodingNfa(const std::string& text) : text(text) { }
+
+	std::vector<std::vector<NfaEdge> > edges;	// By state
+	std::vector<uint32_t> starts;
+	std::vector<uint8_t> accepting;		// By state
+
+	void add(const Glyph* table);		// Encodings through table
+
+private:
+	uint32_t state(uint64_t key);
+	void add_run_edges(uint32_t from, size_t a, size_t q, size_t b);
+
+	const std::string& text;
+	const Glyph* table;
+	std::vector<std::vector<char> > tiles;		// [a][q]: a to q is a run
+	std::map<uint64_t, uint32_t> states;		// By key, of this table
+	std::vector<uint64_t> keys;					// Of states to add edges of
+};
+
+#define FORWARD(p) ((uint64_t) (p))		// At p, between glyphs and runs
+#define AFTER_RUN(p) ((uint64_t) (p) | 1ULL << 62)		// At p, at the end of a run
+#define IN_RUN(a, q, b) ((uint64_t) (a) << 42 | (uint64_t) (q) << 21 | (b) | 1ULL << 63)	// a to q left of run a to b
+
+static bool glyph_at(const Glyph& glyph, const std::string& text, size_t pos)
+{
+	return glyph.size && glyph.size <= text.size() - pos && !text.compare(pos, glyph.size, glyph.text, glyph.size);
+}
+
+static bool starts_rtl(const Glyph* table, const std::string& text, size_t pos)
+{
+	for (int byte = 0; byte < 256; ++byte)
+		if (!(table[byte].flags & GLYPH_LTR) && glyph_at(table[byte], text, pos))
+			return true;
+	return false;
+}
+
+uint32_t EncodingNfa::state(uint64_t key)
+{
+	std::map<uint64_t, uint32_t>::iterator found = states.find(key);
+	if (found != states.end())
+		return found->second;
+	uint32_t id = edges.size();
+	states[key] = id;
+	edges.push_back(std::vector<NfaEdge>());
+	accepting.push_back(key == FORWARD(text.size()) || key == AFTER_RUN(text.size()));
+	keys.push_back(key);
+	return id;
+}
+
+// Edges from state from taking the glyph of a run that ends at q, when a run
+// from a to b is left of it
+void EncodingNfa::add_run_edges(uint32_t from, size_t a, size_t q, size_t b)
+{
+	for (int byte = 0; byte < 256; ++byte)
+	{
+		const Glyph& glyph = table[byte];
+		if (!(glyph.flags & GLYPH_LTR) || glyph.size > q - a || !glyph_at(glyph, text, q - glyph.size)
+				|| !tiles[a][q - glyph.size])
+			continue;
+		size_t rest = q - glyph.size;
+		NfaEdge edge = { (uint8_t) byte, state(rest == a ? AFTER_RUN(b) : IN_RUN(a, rest, b)) };
+		edges[from].push_back(edge);
+	}
+}
+
+void EncodingNfa::add(const Glyph* table)
+{
+	this->table = table;
+	states.clear();
+	keys.clear();
+	size_t n = text.size();
+
+	// Which parts of the text a run of left-to-right glyphs may cover
+	tiles.assign(n + 1, std::vector<char>(n + 1, 0));
+	for (size_t a = 0; a <= n; ++a)
+	{
+		tiles[a][a] = 1;
+		for (size_t q = a; q < n; ++q)
+			if (tiles[a][q])
+				for (int byte = 0; byte < 256; ++byte)
+					if ((table[byte].flags & GLYPH_LTR) && glyph_at(table[byte], text, q))
+						tiles[a][q + table[byte].size] = 1;
+	}
+
+	starts.push_back(state(FORWARD(0)));
+	for (size_t i = 0; i < keys.size(); ++i)		// keys grows as states are found
+	{
+		uint64_t key = keys[i];
+		uint32_t from = states[key];
+		if (key >> 63)
+		{
+			add_run_edges(from, key >> 42 & 0x1FFFFF, key >> 21 & 0x1FFFFF, key & 0x1FFFFF);
+			continue;
+		}
+		size_t p = key & 0x1FFFFF;
+		for (int byte = 0; byte < 256; ++byte)
+		{
+			const Glyph& glyph = table[byte];
+			if (!(glyph.flags & GLYPH_LTR) && glyph_at(glyph, text, p))
+			{
+				NfaEdge edge = { (uint8_t) byte, state(FORWARD(p + glyph.size)) };
+				edges[from].push_back(edge);
+			}
+		}
+		if (key == AFTER_RUN(p))
+			continue;
+		for (size_t b = p + 1; b <= n; ++b)
+			if (tiles[p][b] && (b == n || starts_rtl(table, text, b)))
+				add_run_edges(from, p, b, b);
+	}
+}
+
+bool EncodedMatcher::compile(const std::string& query)
+{
+	// The decoder adds ZWNJ of its own, so it is no part of the encoding
+	std::string text = query;
+	for (size_t at; (at = text.find(ZWNJ)) != std::string::npos; )
+		text.erase(at, sizeof(ZWNJ) - 1);
+
+	next.clear();
+	accepting.clear();
+	overflow = false;
+	if (text.empty() || text.size() >= 1 << 21)
+		return false;
+	EncodingNfa nfa(text);
+	nfa.add(glyphs_fa);
+	nfa.add(glyphs_en);
+
+	// Subsets of NFA states, each holding the starts too, since a match may
+	// begin anywhere.  State 0 is the starts alone.
+	std::vector<uint32_t> start = nfa.starts;
+	std::sort(start.begin(), start.end());
+	std::map<std::vector<uint32_t>, uint32_t> ids;
+	std::vector<std::vector<uint32_t> > subsets(1, start);
+	ids[start] = 0;
+	bool reachable = false;
+	for (size_t i = 0; i < subsets.size(); ++i)
+	{
+		std::vector<uint32_t> targets[256];
+		bool accepts = false;
+		for (size_t j = 0; j < subsets[i].size(); ++j)
+		{
+			uint32_t from = subsets[i][j];
+			accepts = accepts || nfa.accepting[from];
+			for (size_t k = 0; k < nfa.edges[from].size(); ++k)
+				targets[nfa.edges[from][k].byte].push_back(nfa.edges[from][k].to);
+		}
+		accepting.push_back(accepts);
+		reachable = reachable || accepts;
+		next.resize(next.size() + 256, 0);
+		for (int byte = 0; byte < 256; ++byte)
+		{
+			if (targets[byte].empty())
+				continue;
+			std::vector<uint32_t>& subset = targets[byte];
+			subset.insert(subset.end(), start.begin(), start.end());
+			std::sort(subset.begin(), subset.end());
+			subset.erase(std::unique(subset.begin(), subset.end()), subset.end());
+			std::map<std::vector<uint32_t>, uint32_t>::iterator found = ids.find(subset);
+			if (found == ids.end())
+			{
+				if (subsets.size() == MAX_MATCHER_STATES)
+				{
+					overflow = true;
+					return false;
+				}
+				found = ids.insert(std::make_pair(subset, (uint32_t) subsets.size())).first;
+				subsets.push_back(subset);
+			}
+			next[i * 256 + byte] = found->second;
+		}
+	}
+	return reachable;
+}
+
+void EncodedMatcher::find(const uint8_t* data, size_t size, std::vector<size_t>& ends) const
+{
+	const uint32_t* next = this->next.data();
+	const uint8_t* accepting = this->accepting.data();
+	uint32_t state = 0;
+	for (size_t i = 0; i < size; ++i)
+	{
+		state = next[state * 256 + data[i]];
+		if (accepting[state])
+			ends.push_back(i);
+	}
+}
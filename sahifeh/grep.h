@@ -0,0 +1,43 @@
+#ifndef SAHIFEH_GREP_H
+#define SAHIFEH_GREP_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "glyph.h"
+
+#define MAX_MATCHER_STATES 8192		// Of 1 KiB each
+
+// Finds text in Cdf bytes without decoding them.  A query is compiled into
+// a DFA of every byte sequence that decodes to it, through either codepage:
+// the glyphs, and ligatures, that may stand at each position of the query
+// are states of an NFA, which is turned into a DFA searching for all of the
+// sequences at once.  The sequences themselves are never listed, so long
+// phrases with many positional forms compile as quickly as short ones.
+//
+// Matches are candidates only: signatures and format pairs are not told
+// apart from glyphs, and an English pattern may match Persian bytes.  They
+// should be confirmed by decoding.  Text with a span opened or closed in it
+// is missed, and so is a query that ends within a number or English run
+// next to other text, since those runs are stored in reverse.
+class EncodedMatcher
+{
+public:
+	EncodedMatcher() : overflow(false) { }
+
+	// Returns false when nothing decodes to query, or the DFA grows too large
+	bool compile(const std::string& query);
+	bool too_large() const { return overflow; }
+
+	// Appends the offsets of the last bytes of matches, in increasing order
+	void find(const uint8_t* data, size_t size, std::vector<size_t>& ends) const;
+
+private:
+	std::vector<uint32_t> next;			// Transitions, 256 per state
+	std::vector<uint8_t> accepting;		// By state
+	bool overflow;
+};
+
+#endif
@@ -0,0 +1,115 @@
+// Encodes phrases as the Cdf codepage would, and checks that EncodedMatcher
+// finds them where they end, and that the decoder reads them back.
+
+#include <string>
+#include <vector>
+#include <cstdio>
+
+#include "codepage.h"
+#include "decoder.h"
+#include "grep.h"
+#include "scanner.h"
+
+#define ZWNJ "\xE2\x80\x8C"
+
+class TextCollector : public Handler
+{
+public:
+	std::string content;
+
+	virtual void text(const char* text, size_t size) { content.append(text, size); }
+	virtual void ltr(const char* text, size_t size) { content.append(text, size); }
+};
+
+// Bytes of text through the Persian codepage, longest glyph first, with
+// left-to-right runs stored last glyph first
+static bool encode(const std::string& text, std::string& bytes)
+{
+	std::vector<std::string> run;
+	for (size_t pos = 0; pos < text.size(); )
+	{
+		int best = -1;
+		for (int byte = 0; byte < 256; ++byte)
+		{
+			const Glyph& glyph = glyphs_fa[byte];
+			if ((byte < CONTROL_FIRST || byte > CONTROL_LAST) && glyph.size
+					&& glyph.size <= text.size() - pos && !text.compare(pos, glyph.size, glyph.text, glyph.size)
+					&& (best < 0 || glyph.size > glyphs_fa[best].size))
+				best = byte;
+		}
+		if (best < 0)
+			return false;
+		if (glyphs_fa[best].flags & GLYPH_LTR)
+			run.push_back(std::string(1, (char) best));
+		else
+		{
+			for (size_t i = run.size(); i-- > 0; )
+				bytes += run[i];
+			run.clear();
+			bytes += (char) best;
+		}
+		pos += glyphs_fa[best].size;
+	}
+	for (size_t i = run.size(); i-- > 0; )
+		bytes += run[i];
+	return true;
+}
+
+static std::string without_zwnj(std::string text)
+{
+	for (size_t at; (at = text.find(ZWNJ)) != std::string::npos; )
+		text.erase(at, sizeof(ZWNJ) - 1);
+	return text;
+}
+
+static bool check(const char* phrase)
+{
+	std::string encoded;
+	if (!encode(phrase, encoded))
+	{
+		fprintf(stderr, "%s: cannot be encoded\n", phrase);
+		return false;
+	}
+	std::string input = std::string(40, ' ') + encoded + std::string(40, ' ');
+
+	TextCollector collector;
+	Decoder decoder(collector);
+	decoder.decode((const uint8_t*) input.data(), (const uint8_t*) input.data() + input.size(),
+		(const uint8_t*) input.data() + input.size());
+	decoder.finish();
+	if (without_zwnj(collector.content).find(phrase) == std::string::npos)
+	{
+		fprintf(stderr, "%s: does not decode back\n", phrase);
+		return false;
+	}
+
+	EncodedMatcher matcher;
+	if (!matcher.compile(phrase))
+	{
+		fprintf(stderr, "%s: does not compile%s\n", phrase, matcher.too_large() ? " (too large)" : "");
+		return false;
+	}
+	std::vector<size_t> ends;
+	matcher.find((const uint8_t*) input.data(), input.size(), ends);
+	size_t end = 40 + encoded.size() - 1;
+	for (size_t i = 0; i < ends.size(); ++i)
+		if (ends[i] == end)
+			return true;
+	fprintf(stderr, "%s: not found\n", phrase);
+	return false;
+}
+
+int main()
+{
+	static const char* const phrases[] =
+	{
+		"انقلاب اسلامی",
+		"انقلاب اسلامی ایران و امام خمینی",
+		"سال ۱۳۵۷ در تهران",
+		"۱۵ خرداد",
+	};
+	int failed = 0;
+	for (size_t i = 0; i < sizeof(phrases) / sizeof(phrases[0]); ++i)
+		failed += !check(phrases[i]);
+	return failed != 0;
+}
@@ -0,0 +1,51 @@
+#ifndef SAHIFEH_HASH_H
+#define SAHIFEH_HASH_H
+
+#include <cstring>
+#include <stddef.h>
+#include <stdint.h>
+
+// MurmurHash64A, by Austin Appleby.  Fast and well mixed, but not meant to
+// resist anyone choosing collisions.
+static inline uint64_t hash_bytes(const void* key, size_t size, uint64_t seed)
+{
+	const uint64_t m = 0xC6A4A7935BD1E995ULL;
+	const int r = 47;
+	uint64_t h = seed ^ (size * m);
+	const uint8_t* data = (const uint8_t*) key;
+	const uint8_t* end = data + (size & ~(size_t) 7);
+	for (; data != end; data += 8)
+	{
+		uint64_t k;
+		memcpy(&k, data, sizeof(k));
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+		h ^= k;
+		h *= m;
+	}
+	switch (size & 7)
+	{
+		case 7:
+			h ^= (uint64_t) data[6] << 48;
+		case 6:
+			h ^= (uint64_t) data[5] << 40;
+		case 5:
+			h ^= (uint64_t) data[4] << 32;
+		case 4:
+			h ^= (uint64_t) data[3] << 24;
+		case 3:
+			h ^= (uint64_t) data[2] << 16;
+		case 2:
+			h ^= (uint64_t) data[1] << 8;
+		case 1:
+			h ^= (uint64_t) data[0];
+			h *= m;
+	}
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+	return h;
+}
+
+#endif
@@ -0,0 +1,148 @@
+#include "html.h"
+
+#define RLM "\xE2\x80\x8F"
+
+#define LITERAL(s) { s, sizeof(s) - 1 }
+
+struct Literal
+{
+	const char* text;
+	size_t size;
+};
+
+static const Literal span_open_tags[16] =		// By format code, as in span_class()
+{
+	{ NULL, 0 },
+	LITERAL("<span class=\"title\">\n"),
+	{ NULL, 0 },
+	LITERAL("<span class=\"hadith\">\n"),
+	LITERAL("<span class=\"aya\">\n"),
+	LITERAL("<span class=\"poem\">\n"),
+	{ NULL, 0 },
+	{ NULL, 0 },
+	LITERAL("<span class=\"comment\">\n"),
+	{ NULL, 0 },
+	{ NULL, 0 },
+	LITERAL("<span class=\"footnote\">\n"),
+	LITERAL("<span class=\"footnote_aya\">\n"),
+	LITERAL("<span class=\"footnote_hadith\">\n"),
+	LITERAL("<span class=\"footnote_poem\">\n"),
+	LITERAL("<span class=\"footnote_comment\">\n"),
+};
+
+static const char document_start[] = ""
+	"<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.0 Transitional//EN\"\n"
+	"    \"http://www.w3.org/TR/xhtml1/DTD/xhtml1-transitional.dtd\">\n"
+	"<html dir=\"rtl\" xmlns=\"http://www.w3.org/1999/xhtml\">\n"
+	"<head>\n"
+	"<title>";
+static const char document_title[] = "صحیفهٔ نور حضرت امام خمینی";
+static const char document_meta[] = "</title>\n"
+	"<meta http-equiv=\"content-type\" content=\"text/html; charset=utf-8\" />\n"
+	"<meta name=\"generator\" content=\"Khorshid project: http://bitbucket.org/ebrahim/khorshid/\" />\n";
+static const char document_body[] = ""
+	"</head>\n"
+	"<body>\n";
+static const char document_basmala[] = ""
+	"<div align=\"center\">بسم الله الرحمن الرحیم</div>\n"
+	"\n";
+static const char document_footer[] = "</body>\n</html>\n\n";
+
+void HtmlWriter::header()
+{
+	out.write(document_start);
+	out.write(document_title);
+	out.write(document_meta);
+	out.write(document_body);
+	out.write(document_basmala);
+}
+
+void HtmlWriter::header(const std::string& title, const std::string& head)
+{
+	out.write(document_start);
+	out.write(document_title);
+	out.write(" - ");
+	out.write(title.data(), title.size());
+	out.write(document_meta);
+	out.write(head.data(), head.size());
+	out.write(document_body);
+}
+
+void HtmlWriter::reopen(const DecoderState& state)
+{
+	for (int depth = 0; depth < state.span; ++depth)
+		if (depth >= state.span - SPAN_STACK_SIZE)
+			span_open(state.formats[depth % SPAN_STACK_SIZE]);
+		else
+			out.write("<span>\n");		// Its format is not known any more
+}
+
+void HtmlWriter::close_spans(int count)
+{
+	for (; count > 0; --count)
+		span_close();
+}
+
+void HtmlWriter::footer()
+{
+	out.write(document_footer);
+}
+
+void HtmlWriter::page(unsigned volume, unsigned page)
+{
+	out.write("\n<hr /> جلد ");
+	out.number_fa(volume);
+	out.write(" صفحه ");
+	out.number_fa(page);
+	out.write(" <hr />\n");
+}
+
+void HtmlWriter::span_open(uint8_t format)
+{
+	if (format < 16 && span_open_tags[format].text)
+		out.write(span_open_tags[format].text, span_open_tags[format].size);
+	else
+	{
+		out.write("<span class=\"unknown_");
+		out.hex(format);
+		out.write("\">\n");
+	}
+}
+
+void HtmlWriter::span_close()
+{
+	out.write("</span>\n");
+}
+
+void HtmlWriter::text(const char* text, size_t size)
+{
+	out.write(text, size);
+}
+
+void HtmlWriter::ltr(const char* text, size_t size)
+{
+	out.write(text, size);
+	out.write(RLM);
+}
+
+void HtmlWriter::line_break()
+{
+	out.write("<br />\n");
+}
+
+void HtmlWriter::tab()
+{
+	out.write("&nbsp;&nbsp;&nbsp;&nbsp;");
+}
+
+void HtmlWriter::footnote_rule()
+{
+	out.write("<hr class=\"hr_footnote\" />\n");
+}
+
+void HtmlWriter::unknown_byte(uint8_t byte, uint64_t offset)
+{
+	out.write("<!-- unknown byte [");
+	out.hex(byte);
+	out.write("] -->");
+}
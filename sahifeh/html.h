@@ -0,0 +1,42 @@
+#ifndef SAHIFEH_HTML_H
+#define SAHIFEH_HTML_H
+
+#include <string>
+
+#include "decoder.h"
+#include "output.h"
+
+// Writes decoder events as the XHTML page sahifeh has always produced.
+// Unknown bytes and formats are marked with comments and classes.
+class HtmlWriter : public Handler
+{
+public:
+	explicit HtmlWriter(Output& out) : out(out) { }
+
+	void header();		// Document head, up to the start of the text
+	void footer();
+
+	// Head of a part of the document, with title after the document title,
+	// and head added to <head>, such as links to other parts
+	void header(const std::string& title, const std::string& head);
+
+	// Spans around a part of the document: those open in state, as the part
+	// starts, and count of them, as it ends
+	void reopen(const DecoderState& state);
+	void close_spans(int count);
+
+	virtual void page(unsigned volume, unsigned page);
+	virtual void span_open(uint8_t format);
+	virtual void span_close();
+	virtual void text(const char* text, size_t size);
+	virtual void ltr(const char* text, size_t size);
+	virtual void line_break();
+	virtual void tab();
+	virtual void footnote_rule();
+	virtual void unknown_byte(uint8_t byte, uint64_t offset);
+
+private:
+	Output& out;
+};
+
+#endif
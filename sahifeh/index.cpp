@@ -0,0 +1,68 @@
+// Builds a word index of a Cdf file, for sahifeh-search.
+//
+// Usage: sahifeh-index [--fold] input-file index-file
+//
+// With --fold, diacritics are left out of the words, so that searches match
+// words however they were vowelled.
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "decoder.h"
+#include "word_index.h"
+
+static void usage()
+{
+	fputs("Usage: sahifeh-index [--fold] input-file index-file\n", stderr);
+}
+
+int main(int argc, const char* argv[])
+{
+	bool fold = false;
+	int arg = 1;
+	if (arg < argc && !strcmp(argv[arg], "--fold"))
+	{
+		fold = true;
+		++arg;
+	}
+	if (argc - arg != 2)
+	{
+		usage();
+		return 1;
+	}
+	int fd = open(argv[arg], O_RDONLY);
+	if (fd < 0)
+	{
+		fputs("Error: Failed to open input file\n", stderr);
+		return 1;
+	}
+	struct stat st;
+	void* addr = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+		addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+	{
+		fputs("Error: Failed to map input file\n", stderr);
+		return 1;
+	}
+	madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+	const uint8_t* data = (const uint8_t*) addr;
+	WordIndexer indexer(fold);
+	Decoder decoder(indexer);
+	decoder.decode(data, data + st.st_size, data + st.st_size);
+	decoder.finish();
+	munmap(addr, st.st_size);
+
+	if (!indexer.save(argv[arg + 1]))
+	{
+		fputs("Error: Failed to write index file\n", stderr);
+		return 1;
+	}
+	return 0;
+}
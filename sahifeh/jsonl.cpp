@@ -0,0 +1,151 @@
+#include "jsonl.h"
+
+void JsonlWriter::begin(const DecoderState& state)
+{
+	spans = state;
+}
+
+void JsonlWriter::end()
+{
+	close_page();
+}
+
+void JsonlWriter::open_segment()
+{
+	if (!in_page)
+	{
+		out.write("{\"segments\":[");
+		in_page = true;
+		segments = 0;
+	}
+	if (segments++)
+		out.put(',');
+	out.put('{');
+	if (spans.span > 0)
+	{
+		uint8_t format = spans.format();
+		out.write("\"class\":\"");
+		if (const char* name = span_class(format))
+			out.write(name, strlen(name));
+		else
+		{
+			out.write("unknown_");
+			out.hex(format);
+		}
+		out.write("\",");
+	}
+	out.write("\"text\":\"");
+	in_segment = true;
+}
+
+void JsonlWriter::close_segment()
+{
+	if (!in_segment)
+		return;
+	out.write("\"}");
+	in_segment = false;
+}
+
+void JsonlWriter::close_page()
+{
+	close_segment();
+	if (!in_page)
+		return;
+	out.write("]}\n");
+	in_page = false;
+}
+
+void JsonlWriter::write_escaped(const char* text, size_t size)
+{
+	static const char hex_digits[] = "0123456789abcdef";
+	const char* end = text + size;
+	const char* run = text;		// Start of what needs no escaping
+	for (const char* p = text; p < end; ++p)
+	{
+		uint8_t c = *p;
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+		out.write(run, p - run);
+		run = p + 1;
+		switch (c)
+		{
+			case '"':
+				out.write("\\\"");
+				break;
+			case '\\':
+				out.write("\\\\");
+				break;
+			case '\n':
+				out.write("\\n");
+				break;
+			case '\t':
+				out.write("\\t");
+				break;
+			default:
+			{
+				char escape[6] = { '\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0xF] };
+				out.write(escape, sizeof(escape));
+				break;
+			}
+		}
+	}
+	out.write(run, end - run);
+}
+
+void JsonlWriter::page(unsigned volume, unsigned page)
+{
+	close_page();
+	out.write("{\"volume\":");
+	out.number(volume);
+	out.write(",\"page\":");
+	out.number(page);
+	out.write(",\"segments\":[");
+	in_page = true;
+	segments = 0;
+}
+
+void JsonlWriter::span_open(uint8_t format)
+{
+	close_segment();
+	spans.open(format);
+}
+
+void JsonlWriter::span_close()
+{
+	close_segment();
+	if (spans.span > 0)
+		--spans.span;
+}
+
+void JsonlWriter::text(const char* text, size_t size)
+{
+	if (!in_segment)
+		open_segment();
+	write_escaped(text, size);
+}
+
+void JsonlWriter::ltr(const char* text, size_t size)
+{
+	if (!in_segment)
+		open_segment();
+	write_escaped(text, size);
+}
+
+void JsonlWriter::line_break()
+{
+	if (!in_segment)
+		open_segment();
+	out.write("\\n");
+}
+
+void JsonlWriter::tab()
+{
+	if (!in_segment)
+		open_segment();
+	out.write("\\t");
+}
+
+void JsonlWriter::footnote_rule()
+{
+	close_segment();
+}
@@ -0,0 +1,44 @@
+#ifndef SAHIFEH_JSONL_H
+#define SAHIFEH_JSONL_H
+
+#include "decoder.h"
+#include "output.h"
+
+// Writes a JSON object per page, one per line:
+//
+//	{"volume":1,"page":12,"segments":[{"class":"aya","text":"..."},{"text":"..."}]}
+//
+// A segment is text of one span, line breaks and tabs included, and is
+// tagged with the class of the span (see span_class()).  Text outside spans
+// has no class.  Text before the first page goes into an object of its own,
+// without volume and page.
+class JsonlWriter : public Handler
+{
+public:
+	explicit JsonlWriter(Output& out) : out(out), in_page(false), in_segment(false), segments(0) { }
+
+	virtual void begin(const DecoderState& state);
+	virtual void end();
+	virtual void page(unsigned volume, unsigned page);
+	virtual void span_open(uint8_t format);
+	virtual void span_close();
+	virtual void text(const char* text, size_t size);
+	virtual void ltr(const char* text, size_t size);
+	virtual void line_break();
+	virtual void tab();
+	virtual void footnote_rule();
+
+private:
+	void open_segment();
+	void close_segment();
+	void close_page();
+	void write_escaped(const char* text, size_t size);
+
+	Output& out;
+	DecoderState spans;		// Formats of the open spans
+	bool in_page;
+	bool in_segment;
+	unsigned segments;		// Of the current page
+};
+
+#endif
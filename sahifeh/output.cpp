@@ -0,0 +1,109 @@
+#include <cerrno>
+#include <unistd.h>
+
+#include "output.h"
+
+Output::Output(int fd, size_t capacity)
+	: fd(fd), target(NULL), sink(NULL), buf(new char[capacity]), used(0), capacity(capacity), error(false), total(0)
+{
+}
+
+Output::Output(std::string& target, size_t capacity)
+	: fd(-1), target(&target), sink(NULL), buf(new char[capacity]), used(0), capacity(capacity), error(false), total(0)
+{
+}
+
+Output::Output(OutputSink& sink, size_t capacity)
+	: fd(-1), target(NULL), sink(&sink), buf(new char[capacity]), used(0), capacity(capacity), error(false), total(0)
+{
+}
+
+Output::~Output()
+{
+	flush();
+	delete [] buf;
+}
+
+void Output::number(unsigned n)
+{
+	char digits[10];
+	char* p = digits + sizeof(digits);
+	do
+	{
+		*--p = (char) ('0' + n % 10);
+		n /= 10;
+	}
+	while (n);
+	write(p, digits + sizeof(digits) - p);
+}
+
+void Output::number_fa(unsigned n)
+{
+	char digits[2 * 10];
+	char* p = digits + sizeof(digits);
+	do
+	{
+		*--p = (char) (0xB0 + n % 10);		// ۰ is U+06F0, "\xDB\xB0"
+		*--p = (char) 0xDB;
+		n /= 10;
+	}
+	while (n);
+	write(p, digits + sizeof(digits) - p);
+}
+
+void Output::hex(uint8_t byte)
+{
+	static const char hex_digits[] = "0123456789abcdef";
+	if (!byte)
+	{
+		write("00");
+		return;
+	}
+	char text[4] = { '0', 'x', hex_digits[byte >> 4], hex_digits[byte & 0xF] };
+	write(text, sizeof(text));
+}
+
+bool Output::flush()
+{
+	if (used && !write_fd(buf, used))
+		error = true;
+	used = 0;
+	return !error;
+}
+
+void Output::write_through(const char* data, size_t size)
+{
+	flush();
+	if (size < capacity)
+	{
+		memcpy(buf, data, size);
+		used = size;
+	}
+	else if (!write_fd(data, size))
+		error = true;
+}
+
+bool Output::write_fd(const char* data, size_t size)
+{
+	total += size;
+	if (target)
+	{
+		target->append(data, size);
+		return true;
+	}
+	if (sink)
+		return sink->write(data, size);
+	while (size)
+	{
+		ssize_t written = ::write(fd, data, size);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		data += written;
+		size -= written;
+	}
+	return true;
+}
@@ -0,0 +1,95 @@
+#ifndef SAHIFEH_OUTPUT_H
+#define SAHIFEH_OUTPUT_H
+
+#include <string>
+#include <cstring>
+#include <stddef.h>
+#include <stdint.h>
+
+#define OUTPUT_BUFFER_SIZE (1<<20)
+
+// Takes what Output writes out, in place of a file descriptor
+class OutputSink
+{
+public:
+	virtual ~OutputSink() { }
+	virtual bool write(const char* data, size_t size) = 0;
+};
+
+// Buffered writer for decoded output.  Everything goes into one large
+// buffer that is handed to write(2) whenever it fills up, instead of
+// through a stdio call per glyph.  Output kept in memory is appended to a
+// string instead, and output for a sink is handed to it.
+class Output
+{
+public:
+	explicit Output(int fd, size_t capacity = OUTPUT_BUFFER_SIZE);
+	explicit Output(std::string& target, size_t capacity = OUTPUT_BUFFER_SIZE / 16);
+	explicit Output(OutputSink& sink, size_t capacity = OUTPUT_BUFFER_SIZE);
+	~Output();
+
+	void write(const char* data, size_t size)
+	{
+		if (size > capacity - used)
+		{
+			write_through(data, size);
+			return;
+		}
+		memcpy(buf + used, data, size);
+		used += size;
+	}
+
+	// String literals, whose length is known at compile time
+	template <size_t N>
+	void write(const char (&literal)[N])
+	{
+		write(literal, N - 1);
+	}
+
+	// Writes size bytes of data, which must have N bytes readable.  Copying
+	// all N bytes lets the compiler use a few fixed-size moves.
+	template <size_t N>
+	void write_padded(const char* data, size_t size)
+	{
+		if (N > capacity - used)
+		{
+			write(data, size);
+			return;
+		}
+		memcpy(buf + used, data, N);
+		used += size;
+	}
+
+	void put(char c)
+	{
+		if (used == capacity)
+			flush();
+		buf[used++] = c;
+	}
+
+	void number(unsigned n);
+	void number_fa(unsigned n);		// In Persian digits
+	void hex(uint8_t byte);			// Like printf("%#.2x")
+
+	bool flush();
+	bool failed() const { return error; }
+	uint64_t size() const { return total + used; }		// Of all output so far
+
+private:
+	Output(const Output&);
+	Output& operator=(const Output&);
+
+	void write_through(const char* data, size_t size);
+	bool write_fd(const char* data, size_t size);
+
+	int fd;
+	std::string* target;
+	OutputSink* sink;
+	char* buf;
+	size_t used;
+	size_t capacity;
+	bool error;
+	uint64_t total;		// Written out of buf
+};
+
+#endif
@@ -0,0 +1,100 @@
+#include "page_cache.h"
+
+PageCache::PageCache(const uint8_t* data, size_t size, const std::vector<PageMark>& pages, size_t capacity)
+	: data(data), data_size(size), pages(pages), shard_capacity(capacity / PAGE_CACHE_SHARDS)
+{
+	for (size_t i = pages.size(); i-- > 0; )		// The first of a number wins
+		by_number[pages[i].volume << 16 | pages[i].page] = i;
+	for (int i = 0; i < PAGE_CACHE_SHARDS; ++i)
+		shards[i].size = shards[i].hits = shards[i].misses = 0;
+}
+
+void PageCache::decode(size_t mark, Format format, std::string& output) const
+{
+	const uint8_t* begin = data + pages[mark].offset;
+	const uint8_t* end = mark + 1 < pages.size() ? data + pages[mark + 1].offset : data + data_size;
+	Output out(output);
+	Handler* writer = new_writer(format, out);
+	Decoder decoder(*writer, pages[mark].state());
+	decoder.decode(begin, end, data + data_size, begin - data);
+	decoder.finish();
+	delete writer;
+	out.flush();
+}
+
+bool PageCache::get(unsigned volume, unsigned page, Format format, std::string& output)
+{
+	if (volume > 0xFF || page > 0xFFFF)		// Would alias another in the key
+		return false;
+	std::unordered_map<uint32_t, size_t>::const_iterator found = by_number.find(volume << 16 | page);
+	if (found == by_number.end())
+		return false;
+	uint64_t key = (uint64_t) format << 32 | found->first;
+	Shard& shard = shards[(found->first ^ found->first >> 7 ^ format) % PAGE_CACHE_SHARDS];
+	{
+		std::lock_guard<std::mutex> hold(shard.lock);
+		std::unordered_map<uint64_t, std::list<Entry>::iterator>::iterator i = shard.by_key.find(key);
+		if (i != shard.by_key.end())
+		{
+			shard.entries.splice(shard.entries.begin(), shard.entries, i->second);
+			output = i->second->output;
+			++shard.hits;
+			return true;
+		}
+		++shard.misses;
+	}
+
+	// Decoded without the lock, so that other pages of the shard are not
+	// held up; a page two threads miss at once is decoded by both
+	output.clear();
+	decode(found->second, format, output);
+	if (output.size() > shard_capacity)
+		return true;
+	std::lock_guard<std::mutex> hold(shard.lock);
+	if (shard.by_key.count(key))
+		return true;
+	Entry entry = { key, output };
+	shard.entries.push_front(entry);
+	shard.by_key[key] = shard.entries.begin();
+	shard.size += output.size();
+	while (shard.size > shard_capacity)
+	{
+		shard.size -= shard.entries.back().output.size();
+		shard.by_key.erase(shard.entries.back().key);
+		shard.entries.pop_back();
+	}
+	return true;
+}
+
+uint64_t PageCache::hits() const
+{
+	uint64_t hits = 0;
+	for (int i = 0; i < PAGE_CACHE_SHARDS; ++i)
+	{
+		std::lock_guard<std::mutex> hold(shards[i].lock);
+		hits += shards[i].hits;
+	}
+	return hits;
+}
+
+uint64_t PageCache::misses() const
+{
+	uint64_t misses = 0;
+	for (int i = 0; i < PAGE_CACHE_SHARDS; ++i)
+	{
+		std::lock_guard<std::mutex> hold(shards[i].lock);
+		misses += shards[i].misses;
+	}
+	return misses;
+}
+
+size_t PageCache::size() const
+{
+	size_t size = 0;
+	for (int i = 0; i < PAGE_CACHE_SHARDS; ++i)
+	{
+		std::lock_guard<std::mutex> hold(shards[i].lock);
+		size += shards[i].size;
+	}
+	return size;
+}
@@ -0,0 +1,69 @@
+#ifndef SAHIFEH_PAGE_CACHE_H
+#define SAHIFEH_PAGE_CACHE_H
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decoder.h"
+#include "writer.h"
+
+#define PAGE_CACHE_SHARDS 16
+
+// Decoded pages of a Cdf file in memory, found by volume and page number.
+// A page is decoded the first time it is asked for, and the most recently
+// used ones are kept, up to capacity bytes of output in all.  Pages are
+// spread over shards by number, each with a lock of its own, so that any
+// number of threads may read at once.
+class PageCache
+{
+public:
+	// data and pages (of load_page_index()) are used in place, and should
+	// outlive the cache
+	PageCache(const uint8_t* data, size_t size, const std::vector<PageMark>& pages, size_t capacity);
+
+	// Puts the page in output, and returns false when there is no such page.
+	// Of pages of the same number, the first is found.  Numbers beyond a
+	// byte of volume and two of page, as in Cdf, are not found.
+	bool get(unsigned volume, unsigned page, Format format, std::string& output);
+
+	uint64_t hits() const;
+	uint64_t misses() const;
+	size_t size() const;		// Bytes of output kept
+	size_t capacity() const { return shard_capacity * PAGE_CACHE_SHARDS; }
+
+private:
+	PageCache(const PageCache&);
+	PageCache& operator=(const PageCache&);
+
+	struct Entry
+	{
+		uint64_t key;		// Format << 32 | volume << 16 | page
+		std::string output;
+	};
+
+	struct Shard
+	{
+		std::mutex lock;
+		std::list<Entry> entries;		// Most recently used first
+		std::unordered_map<uint64_t, std::list<Entry>::iterator> by_key;
+		size_t size;
+		uint64_t hits;
+		uint64_t misses;
+	};
+
+	void decode(size_t mark, Format format, std::string& output) const;
+
+	const uint8_t* data;
+	size_t data_size;
+	const std::vector<PageMark>& pages;
+	std::unordered_map<uint32_t, size_t> by_number;		// Volume << 16 | page
+	size_t shard_capacity;
+	mutable Shard shards[PAGE_CACHE_SHARDS];
+};
+
+#endif
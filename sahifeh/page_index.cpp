@@ -0,0 +1,134 @@
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+#include "page_index.h"
+
+#define INDEX_MAGIC "SAHIFIDX"
+#define INDEX_VERSION 3
+
+struct IndexHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t count;
+	uint64_t source_size;
+	int64_t source_mtime;		// In nanoseconds
+};
+
+struct IndexEntry
+{
+	uint64_t offset;
+	uint16_t page;
+	uint8_t volume;
+	uint8_t english;
+	int32_t span;
+	uint8_t formats[SPAN_STACK_SIZE];
+};
+
+static bool read_index(const std::string& index_path, const IndexHeader& expected, std::vector<PageMark>& pages)
+{
+	FILE* f = fopen(index_path.c_str(), "rb");
+	if (f == NULL)
+		return false;
+	IndexHeader header;
+	struct stat st;
+	bool ok = fstat(fileno(f), &st) == 0
+		&& fread(&header, sizeof(header), 1, f) == 1
+		&& !memcmp(header.magic, expected.magic, sizeof(header.magic))
+		&& header.version == expected.version
+		&& header.source_size == expected.source_size
+		&& header.source_mtime == expected.source_mtime
+		// A count the file does not hold is a truncated or corrupt index
+		&& (uint64_t) st.st_size == sizeof(header) + (uint64_t) header.count * sizeof(IndexEntry);
+	if (ok && header.count)
+	{
+		std::vector<IndexEntry> entries(header.count);
+		ok = fread(entries.data(), sizeof(IndexEntry), header.count, f) == header.count;
+		for (size_t i = 0; ok && i < entries.size(); ++i)
+		{
+			PageMark mark;
+			mark.offset = entries[i].offset;
+			mark.volume = entries[i].volume;
+			mark.page = entries[i].page;
+			mark.english = entries[i].english;
+			mark.span = entries[i].span;
+			memcpy(mark.formats, entries[i].formats, sizeof(mark.formats));
+			ok = mark.offset < header.source_size;
+			pages.push_back(mark);
+		}
+	}
+	fclose(f);
+	if (!ok)
+		pages.clear();
+	return ok;
+}
+
+static void write_index(const std::string& index_path, IndexHeader header, const std::vector<PageMark>& pages)
+{
+	std::vector<IndexEntry> entries(pages.size());
+	for (size_t i = 0; i < pages.size(); ++i)
+	{
+		entries[i].offset = pages[i].offset;
+		entries[i].page = pages[i].page;
+		entries[i].volume = pages[i].volume;
+		entries[i].english = pages[i].english;
+		entries[i].span = pages[i].span;
+		memcpy(entries[i].formats, pages[i].formats, sizeof(entries[i].formats));
+	}
+	header.count = entries.size();
+
+	// Written aside and renamed, so that readers never see half an index
+	std::string temp_path = index_path + ".tmp";
+	FILE* f = fopen(temp_path.c_str(), "wb");
+	if (f == NULL)
+		return;
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+		&& (entries.empty() || fwrite(entries.data(), sizeof(IndexEntry), entries.size(), f) == entries.size());
+	if (fclose(f) != 0 || !ok || rename(temp_path.c_str(), index_path.c_str()) != 0)
+		remove(temp_path.c_str());
+}
+
+void load_page_index(const char* path, const uint8_t* data, size_t size, std::vector<PageMark>& pages)
+{
+	pages.clear();
+	IndexHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+	header.version = INDEX_VERSION;
+	header.source_size = size;
+	struct stat st;
+	if (stat(path, &st) == 0)
+		header.source_mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+
+	std::string index_path = std::string(path) + ".idx";
+	if (read_index(index_path, header, pages))
+		return;
+	scan_pages(data, data + size, pages);
+	write_index(index_path, header, pages);
+}
+
+bool find_pages(const std::vector<PageMark>& pages, unsigned volume, unsigned first, unsigned last, size_t& begin, size_t& end)
+{
+	begin = end = 0;
+	for (size_t i = 0; i < pages.size(); ++i)
+		if (pages[i].volume == volume && first <= pages[i].page && pages[i].page <= last)
+		{
+			if (end == 0)
+				begin = i;
+			end = i + 1;
+		}
+	return end != 0;
+}
+
+void split_pages(const std::vector<PageMark>& pages, size_t task_size, std::vector<size_t>& starts)
+{
+	size_t begin = 0;
+	for (size_t i = 0; i < pages.size(); ++i)
+		if (pages[i].offset - begin >= task_size)
+		{
+			starts.push_back(i);
+			begin = pages[i].offset;
+		}
+}
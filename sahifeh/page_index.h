@@ -0,0 +1,25 @@
+#ifndef SAHIFEH_PAGE_INDEX_H
+#define SAHIFEH_PAGE_INDEX_H
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decoder.h"
+
+// Fills pages with the page marks of the input file at path, whose contents
+// are data.  They are read from the index file next to it (path + ".idx")
+// when that was built from a file of the same size and modification time,
+// and are scanned and saved there otherwise.  Failing to save the index is
+// not an error.
+void load_page_index(const char* path, const uint8_t* data, size_t size, std::vector<PageMark>& pages);
+
+// Finds the pages of volume numbered first to last, and returns the index of
+// the first of them in begin and of the page after the last one in end.
+bool find_pages(const std::vector<PageMark>& pages, unsigned volume, unsigned first, unsigned last, size_t& begin, size_t& end);
+
+// Splits pages into runs of at least task_size bytes, and returns in starts
+// the page each run but the first begins with
+void split_pages(const std::vector<PageMark>& pages, size_t task_size, std::vector<size_t>& starts);
+
+#endif
@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "hash.h"
+#include "render_cache.h"
+
+RenderCache::RenderCache(const char* dir, const char* extension)
+	: dir(dir), extension(extension)
+{
+	tag = hash_bytes(extension, this->extension.size(), decoder_version());
+}
+
+bool RenderCache::create()
+{
+	struct stat st;
+	return (mkdir(dir.c_str(), 0777) == 0 || errno == EEXIST)
+		&& stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+uint64_t RenderCache::key(const uint8_t* begin, const uint8_t* end, const uint8_t* input_end, const DecoderState& state) const
+{
+	// The last step of a page may look a few bytes into the next one, and
+	// steps are cut short at the very end of the input
+	size_t look_ahead = std::min((size_t) (input_end - end), (size_t) MAX_STEP);
+	int32_t span = state.span;
+	uint64_t seed = tag ^ (end - begin) ^ (uint64_t) state.english << 62 ^ (uint64_t) (end == input_end) << 63;
+	seed = hash_bytes(&span, sizeof(span), seed);
+	seed = hash_bytes(state.formats, std::min(std::max(span, 0), SPAN_STACK_SIZE), seed);
+	return hash_bytes(begin, end - begin + look_ahead, seed);
+}
+
+std::string RenderCache::path(uint64_t key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.", (unsigned long long) key);
+	return dir + name + extension;
+}
+
+bool RenderCache::load(uint64_t key, std::string& output) const
+{
+	FILE* f = fopen(path(key).c_str(), "rb");
+	if (f == NULL)
+		return false;
+	struct stat st;
+	bool ok = fstat(fileno(f), &st) == 0;
+	if (ok)
+	{
+		output.resize(st.st_size);
+		ok = fread(&output[0], 1, output.size(), f) == output.size();
+	}
+	fclose(f);
+	return ok;
+}
+
+void RenderCache::store(uint64_t key, const std::string& output) const
+{
+	// Written aside and renamed, so that readers never see half a page
+	std::string final_path = path(key);
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%d.tmp", (int) getpid());
+	std::string temp_path = final_path + suffix;
+	FILE* f = fopen(temp_path.c_str(), "wb");
+	if (f == NULL)
+		return;
+	bool ok = fwrite(output.data(), 1, output.size(), f) == output.size();
+	if (fclose(f) != 0 || !ok || rename(temp_path.c_str(), final_path.c_str()) != 0)
+		remove(temp_path.c_str());
+}
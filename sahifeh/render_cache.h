@@ -0,0 +1,36 @@
+#ifndef SAHIFEH_RENDER_CACHE_H
+#define SAHIFEH_RENDER_CACHE_H
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decoder.h"
+
+// Decoded pages kept in a directory, a file each, so that an input that
+// changed in a few pages is decoded again in those pages only.  A page is
+// found by a hash of its bytes, of the decoder state it starts in and of
+// the version of the decoder and its glyph tables.
+class RenderCache
+{
+public:
+	// Files are named by key, with extension telling output formats apart
+	RenderCache(const char* dir, const char* extension);
+
+	bool create();		// Makes the directory when missing
+
+	// Key of the page in begin to end of an input ending at input_end
+	uint64_t key(const uint8_t* begin, const uint8_t* end, const uint8_t* input_end, const DecoderState& state) const;
+
+	bool load(uint64_t key, std::string& output) const;
+	void store(uint64_t key, const std::string& output) const;		// Failing silently
+
+private:
+	std::string path(uint64_t key) const;
+
+	std::string dir;
+	std::string extension;
+	uint64_t tag;
+};
+
+#endif
@@ -1,852 +1,595 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
 #include <cstdio>
 #include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#define MAX_SIZE (1<<24)
-#define NEW_PAGE 0x000182
-#define ENGLISH_START 0x020181
-#define ENGLISH_END 0x01007A
-#define ZWNJ "\xE2\x80\x8C"
-#define RLM "\xE2\x80\x8F"
+#include "analyze.h"
+#include "async_io.h"
+#include "batch.h"
+#include "compress.h"
+#include "decoder.h"
+#include "grep.h"
+#include "output.h"
+#include "page_index.h"
+#include "render_cache.h"
+#include "split.h"
+#include "writer.h"
 
-static const char* header = ""
-	"<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.0 Transitional//EN\"\n"
-	"    \"http://www.w3.org/TR/xhtml1/DTD/xhtml1-transitional.dtd\">\n"
-	"<html dir=\"rtl\" xmlns=\"http://www.w3.org/1999/xhtml\">\n"
-	"<head>\n"
-	"<title>صحیفهٔ نور حضرت امام خمینی</title>\n"
-	"<meta http-equiv=\"content-type\" content=\"text/html; charset=utf-8\" />\n"
-	"<meta name=\"generator\" content=\"Khorshid project: http://bitbucket.org/ebrahim/khorshid/\" />\n"
-	"</head>\n"
-	"<body>\n"
-	"<div align=\"center\">بسم الله الرحمن الرحیم</div>\n";
-static const char* footer = "</body>\n</html>\n";
+#define CHUNK_SIZE (1<<16)
+#define MIN_TASK_SIZE (1<<16)
 
-static const char* digits_fa[10] =
+struct Range		// A run of whole pages decoded by one job
 {
-	"\xDB\xB0",		// ۰
-	"\xDB\xB1",		// ۱
-	"\xDB\xB2",		// ۲
-	"\xDB\xB3",		// ۳
-	"\xDB\xB4",		// ۴
-	"\xDB\xB5",		// ۵
-	"\xDB\xB6",		// ۶
-	"\xDB\xB7",		// ۷
-	"\xDB\xB8",		// ۸
-	"\xDB\xB9",		// ۹
+	const uint8_t* begin;
+	const uint8_t* end;
+	DecoderState state;
+	std::string output;
+	bool done;
+	bool cached;		// Loaded from the cache, and done from the start
+	uint64_t key;		// In the cache
 };
 
-enum CharJoining		// What a char does while it shouldn't
+// Decodes the ranges that are not done on jobs threads, and writes all of
+// them in their original order.  Each range starts from the state the page
+// scan found at its first page.  With a cache, decoded ranges are stored
+// in it as well.  With stats, each thread counts on its own, and adds its
+// counts to stats at the end.
+static void decode_ranges(Output& out, Format format, std::vector<Range>& ranges,
+		const uint8_t* data, size_t size, unsigned jobs, const RenderCache* cache, DecodeStats* stats)
 {
-	JOINS_NONE = 0,		// Leave it alone. It doesn't join badly.
-	JOINS_PREV = 1,		// If previous has JOINS_NEXT, it accepts
-	JOINS_NEXT = 2,		// Tries to join the next character, while it shouldn't
-	JOINS_BOTH = JOINS_PREV | JOINS_NEXT,
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < jobs; ++i)
+		threads.push_back(std::thread([&]()
+		{
+			DecodeStats* thread_stats = stats ? new DecodeStats(stats->verbose) : NULL;
+			for (size_t i; (i = next++) < ranges.size(); )
+			{
+				Range& range = ranges[i];
+				if (range.cached)
+					continue;
+				std::string output;
+				{
+					Output range_out(output);
+					Handler* writer = new_writer(format, range_out);
+					Decoder decoder(*writer, range.state, thread_stats);
+					decoder.decode(range.begin, range.end, data + size, range.begin - data);
+					decoder.finish();
+					delete writer;
+				}
+				std::lock_guard<std::mutex> lock(mutex);
+				range.output.swap(output);
+				range.done = true;
+				ready.notify_one();
+			}
+			if (thread_stats)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stats->merge(*thread_stats);
+				delete thread_stats;
+			}
+		}));
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!ranges[i].done)
+			ready.wait(lock);
+		std::string output;
+		output.swap(ranges[i].output);
+		lock.unlock();
+		out.write(output.data(), output.size());
+		if (cache && !ranges[i].cached)
+			cache->store(ranges[i].key, output);
+	}
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+}
+
+// Decodes input on jobs threads, a few pages per task
+static void decode_parallel(Output& out, Format format, const uint8_t* data, size_t size, unsigned jobs,
+		DecodeStats* stats)
+{
+	std::vector<PageMark> pages;
+	scan_pages(data, data + size, pages);
+
+	// Several tasks per thread even out pages of different weight
+	size_t task_size = std::max(size / (jobs * 8), (size_t) MIN_TASK_SIZE);
+	std::vector<size_t> starts;
+	split_pages(pages, task_size, starts);
+	std::vector<Range> ranges;
+	Range range = { data, data + size, DecoderState(), std::string(), false, false, 0 };
+	for (size_t i = 0; i < starts.size(); ++i)
+	{
+		const PageMark& start = pages[starts[i]];
+		range.end = data + start.offset;
+		ranges.push_back(range);
+		range.begin = data + start.offset;
+		range.state = start.state();
+	}
+	range.end = data + size;
+	ranges.push_back(range);
+	decode_ranges(out, format, ranges, data, size, jobs, NULL, stats);
+}
+
+// Decodes pages first to last, and text before the first page with
+// leading, taking what it can from the cache instead
+static void decode_cached(Output& out, Format format, const uint8_t* data, size_t size,
+		const std::vector<PageMark>& pages, size_t first, size_t last, bool leading,
+		unsigned jobs, const RenderCache& cache, DecodeStats* stats)
+{
+	std::vector<Range> ranges;
+	Range range = { data, data + size, DecoderState(), std::string(), false, false, 0 };
+	if (leading && (pages.empty() || pages[0].offset > 0))
+	{
+		if (!pages.empty())
+			range.end = data + pages[0].offset;
+		ranges.push_back(range);
+	}
+	for (size_t i = first; i < last; ++i)
+	{
+		range.begin = data + pages[i].offset;
+		range.end = i + 1 < pages.size() ? data + pages[i + 1].offset : data + size;
+		range.state = pages[i].state();
+		ranges.push_back(range);
+	}
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		Range& range = ranges[i];
+		range.key = cache.key(range.begin, range.end, data + size, range.state);
+		range.done = range.cached = cache.load(range.key, range.output);
+	}
+	decode_ranges(out, format, ranges, data, size, jobs, &cache, stats);
+}
+
+// Text of a page for --grep, without unknown bytes
+class PageText : public Handler
+{
+public:
+	std::string content;
+
+	virtual void text(const char* text, size_t size) { content.append(text, size); }
+	virtual void ltr(const char* text, size_t size) { content.append(text, size); }
+	virtual void line_break() { content += '\n'; }
+	virtual void tab() { content += '\t'; }
+	virtual void footnote_rule() { content += '\n'; }
 };
 
+static std::string without_zwnj(const std::string& text)
+{
+	static const char zwnj[] = "\xE2\x80\x8C";
+	std::string result;
+	for (size_t at = 0, found; at < text.size(); at = found + sizeof(zwnj) - 1)
+	{
+		found = std::min(text.find(zwnj, at), text.size());
+		result.append(text, at, found - at);
+	}
+	return result;
+}
+
+// Writes the lines that contain query, as volume:page:line.  Only pages
+// where the matcher finds the encoded query are decoded.
+static void grep(Output& out, const char* path, const uint8_t* data, size_t size,
+		const std::string& query, const EncodedMatcher& matcher)
+{
+	std::vector<size_t> ends;
+	matcher.find(data, size, ends);
+	if (ends.empty())
+		return;
+	std::vector<PageMark> pages;
+	load_page_index(path, data, size, pages);
+	std::string wanted = without_zwnj(query);
+	for (size_t i = 0; i < ends.size(); )
+	{
+		// The page of the match, or text before the first page
+		size_t next = std::upper_bound(pages.begin(), pages.end(), ends[i],
+			[](size_t offset, const PageMark& mark) { return offset < mark.offset; }) - pages.begin();
+		const uint8_t* begin = next ? data + pages[next - 1].offset : data;
+		const uint8_t* end = next < pages.size() ? data + pages[next].offset : data + size;
+		while (i < ends.size() && data + ends[i] < end)
+			++i;
+
+		PageText page;
+		Decoder decoder(page, next ? pages[next - 1].state() : DecoderState());
+		decoder.decode(begin, end, data + size, begin - data);
+		decoder.finish();
+		for (size_t at = 0, line_end; at < page.content.size(); at = line_end + 1)
+		{
+			line_end = std::min(page.content.find('\n', at), page.content.size());
+			std::string line = page.content.substr(at, line_end - at);
+			if (without_zwnj(line).find(wanted) == std::string::npos)
+				continue;
+			out.number(next ? pages[next - 1].volume : 0);
+			out.put(':');
+			out.number(next ? pages[next - 1].page : 0);
+			out.put(':');
+			out.write(line.data(), line.size());
+			out.put('\n');
+		}
+	}
+}
+
+static void usage()
+{
+	fputs("Usage: sahifeh [-j jobs] [-v] [--stats] [--format=html|text|jsonl] [--compress=gzip|zstd] [--cache dir]\n"
+		"              [--io=mmap|uring|threads] [--volume V [--pages A[-B]]] [input-file]\n"
+		"       sahifeh --split=volume|page --outdir dir [-j jobs] input-file\n"
+		"       sahifeh --analyze [-j jobs] input-file\n"
+		"       sahifeh --grep query input-file\n"
+		"       sahifeh --batch dir|list [--outdir dir] [-j jobs] [--format=html|text|jsonl]\n", stderr);
+}
+
 int main(int argc, const char* argv[])
 {
-	if (argc > 1 && freopen(argv[1], "r", stdin) == NULL)
+	unsigned jobs = 0;		// One, or all cores in batch mode
+	Format format = FORMAT_HTML;
+	int volume = -1;
+	const char* query = NULL;
+	const char* cache_dir = NULL;
+	const char* batch = NULL;
+	const char* outdir = NULL;
+	bool verbose = false, show_stats = false;
+	bool compress = false;
+	Compression compression = COMPRESS_GZIP;
+	bool async_io = false;
+	bool split = false;
+	bool analyze = false;
+	SplitMode split_mode = SPLIT_VOLUME;
+	IoBackend io_backend = IO_URING;
+	unsigned first_page = 0, last_page = 0xFFFF;
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-' && argv[arg][1]; ++arg)
+	{
+		bool ok = true;
+		if (!strcmp(argv[arg], "-j") && arg + 1 < argc)
+			ok = (jobs = atoi(argv[++arg])) >= 1;
+		else if (!strncmp(argv[arg], "-j", 2))
+			ok = (jobs = atoi(argv[arg] + 2)) >= 1;
+		else if (!strcmp(argv[arg], "-v"))
+			verbose = true;
+		else if (!strcmp(argv[arg], "--stats"))
+			show_stats = true;
+		else if (!strcmp(argv[arg], "--format=html"))
+			format = FORMAT_HTML;
+		else if (!strcmp(argv[arg], "--format=text"))
+			format = FORMAT_TEXT;
+		else if (!strcmp(argv[arg], "--format=jsonl"))
+			format = FORMAT_JSONL;
+		else if (!strcmp(argv[arg], "--compress=gzip"))
+		{
+			compress = true;
+			compression = COMPRESS_GZIP;
+		}
+		else if (!strcmp(argv[arg], "--compress=zstd"))
+		{
+			compress = true;
+			compression = COMPRESS_ZSTD;
+		}
+		else if (!strcmp(argv[arg], "--io=mmap"))
+			async_io = false;
+		else if (!strcmp(argv[arg], "--io=uring"))
+		{
+			async_io = true;
+			io_backend = IO_URING;
+		}
+		else if (!strcmp(argv[arg], "--io=threads"))
+		{
+			async_io = true;
+			io_backend = IO_THREADS;
+		}
+		else if (!strcmp(argv[arg], "--split=volume"))
+		{
+			split = true;
+			split_mode = SPLIT_VOLUME;
+		}
+		else if (!strcmp(argv[arg], "--split=page"))
+		{
+			split = true;
+			split_mode = SPLIT_PAGE;
+		}
+		else if (!strcmp(argv[arg], "--analyze"))
+			analyze = true;
+		else if (!strcmp(argv[arg], "--cache") && arg + 1 < argc)
+			cache_dir = argv[++arg];
+		else if (!strcmp(argv[arg], "--batch") && arg + 1 < argc)
+			batch = argv[++arg];
+		else if (!strcmp(argv[arg], "--outdir") && arg + 1 < argc)
+			outdir = argv[++arg];
+		else if (!strcmp(argv[arg], "--grep") && arg + 1 < argc)
+			query = argv[++arg];
+		else if (!strcmp(argv[arg], "--volume") && arg + 1 < argc)
+			ok = (volume = atoi(argv[++arg])) >= 0;
+		else if (!strcmp(argv[arg], "--pages") && arg + 1 < argc)
+		{
+			int used = 0;
+			ok = sscanf(argv[++arg], "%u%n-%u%n", &first_page, &used, &last_page, &used) >= 1
+				&& !argv[arg][used];
+			if (ok && !strchr(argv[arg], '-'))
+				last_page = first_page;
+		}
+		else
+			ok = false;
+		if (!ok)
+		{
+			usage();
+			return 1;
+		}
+	}
+	if (argc - arg > 1 || (batch && (arg < argc || volume >= 0 || query || cache_dir || verbose || show_stats || compress))
+		|| (outdir && !batch && !split) || (query && (verbose || show_stats || compress))
+		|| (split && (!outdir || batch || query || volume >= 0 || cache_dir || compress || format != FORMAT_HTML))
+		|| (analyze && (split || batch || query || volume >= 0 || cache_dir || verbose || show_stats || compress
+			|| async_io || format != FORMAT_HTML)))
+	{
+		usage();
+		return 1;
+	}
+	if (compress && !Compressor::supported(compression))
+	{
+		fputs("Error: This build does not support that compression\n", stderr);
+		return 1;
+	}
+	if ((batch || split || analyze) && jobs == 0)
+		jobs = std::max(std::thread::hardware_concurrency(), 1u);
+	if (batch)
+		return convert_batch(batch, outdir, format, jobs) != 0;
+	if (jobs == 0)
+		jobs = 1;
+	int fd = 0;
+	if (arg < argc && (fd = open(argv[arg], O_RDONLY)) < 0)
 	{
 		fputs("Error: Failed to open input file\n", stderr);
 		return 1;
 	}
-	const char* map[256] = { NULL };
-	uint8_t map_size[256] = { 0 };
-	CharJoining map_joining[256] = { JOINS_NONE };
-	for (int i = 0; i < 256; ++i)
-		switch (i)
+	struct stat st;
+	void* addr = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+		addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (volume >= 0 && (addr == MAP_FAILED || arg == argc))
+	{
+		fputs("Error: --volume needs an input file\n", stderr);
+		return 1;
+	}
+	if (cache_dir && (addr == MAP_FAILED || arg == argc))
+	{
+		fputs("Error: --cache needs an input file\n", stderr);
+		return 1;
+	}
+	if (cache_dir && show_stats)
+	{
+		fputs("Error: --stats does not count pages taken from --cache\n", stderr);
+		return 1;
+	}
+	if (split)
+	{
+		if (addr == MAP_FAILED || arg == argc)
 		{
-			case 0x01:		// که
-				map[i] = "\xDA\xA9\xD9\x87";
-				map_size[i] = 4;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0x02:		// به
-				map[i] = "\xD8\xA8\xD9\x87";
-				map_size[i] = 4;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0x03:		// را
-				map[i] = "\xD8\xB1\xD8\xA7";
-				map_size[i] = 4;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0x04:		// در
-				map[i] = "\xD8\xAF\xD8\xB1";
-				map_size[i] = 4;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0x05:		// این
-				map[i] = "\xD8\xA7\xDB\x8C\xD9\x86";
-				map_size[i] = 6;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0x06:		// از
-				map[i] = "\xD8\xA7\xD8\xB2";
-				map_size[i] = 4;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0x07:		// است
-				map[i] = "\xD8\xA7\xD8\xB3\xD8\xAA";
-				map_size[i] = 6;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0x08:		// ما
-				map[i] = "\xD9\x85\xD8\xA7";
-				map_size[i] = 4;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0x20:		// فاصله
-				map[i] = " ";
-				map_size[i] = 1;
-				break;
-			case 0x65:		// .
-				map[i] = ".";
-				map_size[i] = 1;
-				break;
-			case 0x66:		// :
-				map[i] = ":";
-				map_size[i] = 1;
-				break;
-			case 0x67:		// ؛
-				map[i] = "\xD8\x9B";
-				map_size[i] = 2;
-				break;
-			case 0x69:		// ، (ویرگول)
-				map[i] = "\xD8\x8C";
-				map_size[i] = 2;
-				break;
-			case 0x6A:		// ؟
-				map[i] = "\xD8\x9F";
-				map_size[i] = 2;
-				break;
-			case 0x6B:		// (
-				map[i] = "(";
-				map_size[i] = 1;
-				break;
-			case 0x6C:		// )
-				map[i] = ")";
-				map_size[i] = 1;
-				break;
-			case 0x6D:		// [
-				map[i] = "[";
-				map_size[i] = 1;
-				break;
-			case 0x6E:		// ]
-				map[i] = "]";
-				map_size[i] = 1;
-				break;
-			case 0x71:		// !
-				map[i] = "!";
-				map_size[i] = 1;
-				break;
-			case 0x72:		// -
-				map[i] = "-";
-				map_size[i] = 1;
-				break;
-			case 0x73:		// «
-				map[i] = "\xC2\xAB";
-				map_size[i] = 2;
-				break;
-			case 0x74:		// »
-				map[i] = "\xC2\xBB";
-				map_size[i] = 2;
-				break;
-			case 0x00:		// سر خط؟
-			case 0x75:		// سر خط
-				map[i] = "<br />\n";
-				map_size[i] = 7;
-				break;
-			case 0x76:		// tab
-				map[i] = "&nbsp;&nbsp;&nbsp;&nbsp;";
-				map_size[i] = 24;
-				break;
-			case 0x77:		// /
-				map[i] = "/";
-				map_size[i] = 1;
-				break;
-			case 0x7A:		// *
-				map[i] = "*";
-				map_size[i] = 1;
-				break;
-			case 0x8D:		// ۰
-				map[i] = "\xDB\xB0";
-				map_size[i] = 2;
-				break;
-			case 0x8E:		// ۱
-				map[i] = "\xDB\xB1";
-				map_size[i] = 2;
-				break;
-			case 0x8F:		// ۲
-				map[i] = "\xDB\xB2";
-				map_size[i] = 2;
-				break;
-			case 0x90:		// ۳
-				map[i] = "\xDB\xB3";
-				map_size[i] = 2;
-				break;
-			case 0x91:		// ۴
-				map[i] = "\xDB\xB4";
-				map_size[i] = 2;
-				break;
-			case 0x92:		// ۵
-				map[i] = "\xDB\xB5";
-				map_size[i] = 2;
-				break;
-			case 0x93:		// ۶
-				map[i] = "\xDB\xB6";
-				map_size[i] = 2;
-				break;
-			case 0x94:		// ۷
-				map[i] = "\xDB\xB7";
-				map_size[i] = 2;
-				break;
-			case 0x95:		// ۸
-				map[i] = "\xDB\xB8";
-				map_size[i] = 2;
-				break;
-			case 0x96:		// ۹
-				map[i] = "\xDB\xB9";
-				map_size[i] = 2;
-				break;
-			case 0x97:		// فتحه
-				map[i] = "\xD9\x8E";
-				map_size[i] = 2;
-				break;
-			case 0x98:		// کسره
-				map[i] = "\xD9\x90";
-				map_size[i] = 2;
-				break;
-			case 0x99:		// ضمه
-				map[i] = "\xD9\x8F";
-				map_size[i] = 2;
-				break;
-			case 0x9A:		// الف مقصوره منصوب
-				map[i] = "\xD9\xB0";
-				map_size[i] = 2;
-				break;
-			case 0x9B:		// الف مقصوره مکسور
-				map[i] = "\xD9\x96";
-				map_size[i] = 2;
-				break;
-			case 0x9C:		// تنوین نصب
-				map[i] = "\xD9\x8B";
-				map_size[i] = 2;
-				break;
-			case 0x9D:		// تنوین کسر
-				map[i] = "\xD9\x8D";
-				map_size[i] = 2;
-				break;
-			case 0xA1:		// تنوین رفع
-				map[i] = "\xD9\x8C";
-				map_size[i] = 2;
-				break;
-			case 0xA2:		// تشدید منصوب
-				map[i] = "\xD9\x91\xD9\x8E";
-				map_size[i] = 4;
-				break;
-			case 0xA4:		// تشدید مکسور
-				map[i] = "\xD9\x91\xD9\x90";
-				map_size[i] = 4;
-				break;
-			case 0xA5:		// تشدید مرفوع
-				map[i] = "\xD9\x91\xD9\x8F";
-				map_size[i] = 4;
-				break;
-			case 0xA8:		// تشدید و الف مقصوره
-				map[i] = "\xD9\x91\xD9\xB0";
-				map_size[i] = 0;		// عمداً حذف شد
-				break;
-			case 0xA9:		// تشدید و تنوین نصب
-				map[i] = "\xD9\x91\xD9\x8B";
-				map_size[i] = 4;
-				break;
-			case 0xAA:		// تشدید و تنوین کسر
-				map[i] = "\xD9\x91\xD9\x8D";
-				map_size[i] = 4;
-				break;
-			case 0xAB:		// تشدید و تنوین رفع
-				map[i] = "\xD9\x91\xD9\x8C";
-				map_size[i] = 4;
-				break;
-			case 0xAC:		// تشدید
-				map[i] = "\xD9\x91";
-				map_size[i] = 2;
-				break;
-			case 0xAD:		// علامت سکون
-				map[i] = "\xD9\x92";
-				map_size[i] = 2;
-				break;
-			case 0xB0:		// آ جدا
-				map_joining[i] = JOINS_PREV;
-			case 0xB1:		// آ آخری (مثل الآن)
-				map[i] = "\xD8\xA2";
-				map_size[i] = 2;
-				break;
-			case 0xB2:		// الف جدا
-				map_joining[i] = JOINS_PREV;
-			case 0xB3:		// الف آخر
-				map[i] = "\xD8\xA7";
-				map_size[i] = 2;
-				break;
-			case 0xB4:		// همزه جدا
-				map[i] = "\xD8\xA1";
-				map_size[i] = 2;
-				break;
-			case 0xB5:		// الف و همزه منصوب اول
-				map_joining[i] = JOINS_PREV;
-			case 0xB6:		// الف و همزه منصوب آخر
-				map[i] = "\xD8\xA3";
-				map_size[i] = 2;
-				break;
-			case 0xB7:		// ﺎﻠﻓ ﻭ ﻪﻣﺰﻫ ﻡکﺱﻭﺭ ﺍﻮﻟ
-				map_joining[i] = JOINS_PREV;
-			case 0xB8:		// ﺎﻠﻓ ﻭ ﻪﻣﺰﻫ ﻡکﺱﻭﺭ آخر
-				map[i] = "\xD8\xA5";
-				map_size[i] = 2;
-				break;
-			case 0xB9:		// ؤ آخر
-				map[i] = "\xD8\xA4";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xBA:		// ئ آخر
-				map[i] = "\xD8\xA6";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xBC:		// ئ اول
-				map[i] = "\xD8\xA6";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xBD:		// ب آخر
-				map[i] = "\xD8\xA8";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xBE:		// ب اول
-				map[i] = "\xD8\xA8";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xBF:		// پ آخر
-				map[i] = "\xD9\xBE";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xC0:		// پ اول
-				map[i] = "\xD9\xBE";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xC1:		// ت آخر
-				map[i] = "\xD8\xAA";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xC2:		// ت اول
-				map[i] = "\xD8\xAA";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xC3:		// ة جدا
-				map[i] = "\xD8\xA9";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xC4:		// ث آخر
-				map[i] = "\xD8\xAB";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xC5:		// ث اول
-				map[i] = "\xD8\xAB";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xC6:		// جیم آخر
-				map[i] = "\xD8\xAC";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xC7:		// جیم اول
-				map[i] = "\xD8\xAC";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xC8:		// چ آخر
-				map[i] = "\xDA\x86";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xC9:		// چ اول
-				map[i] = "\xDA\x86";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xCA:		// ح آخر
-				map[i] = "\xD8\xAD";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xCB:		// ح اول
-				map[i] = "\xD8\xAD";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xCC:		// خ آخر
-				map[i] = "\xD8\xAE";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xCD:		// خ اول و وسط
-				map[i] = "\xD8\xAE";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xCE:		// دال جدا و آخر
-				map[i] = "\xD8\xAF";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xCF:		// ذال جدا
-				map[i] = "\xD8\xB0";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xD0:		// ر آخر
-				map[i] = "\xD8\xB1";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xD1:		// ز جدا و آخر
-				map[i] = "\xD8\xB2";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xD2:		// ژ آخر
-				map[i] = "\xDA\x98";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xD3:		// سین آخر
-				map[i] = "\xD8\xB3";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xD4:		// سین اول
-				map[i] = "\xD8\xB3";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xD5:		// شین جدا
-				map[i] = "\xD8\xB4";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xD6:		// شین اول و وسط
-				map[i] = "\xD8\xB4";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xD7:		// صاد آخر
-				map[i] = "\xD8\xB5";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xD8:		// صاد وسط
-				map[i] = "\xD8\xB5";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xD9:		// ضاد آخر
-				map[i] = "\xD8\xB6";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xDA:		// ضاد اول
-				map[i] = "\xD8\xB6";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xDB:		// طای اول
-				map[i] = "\xD8\xB7";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xDC:		// ظای اول
-				map[i] = "\xD8\xB8";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xDD:		// عین جدا
-			case 0xDE:		// عین آخر
-				map[i] = "\xD8\xB9";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xDF:		// عین اول
-			case 0xE1:		// عین وسط
-				map[i] = "\xD8\xB9";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xE2:		// غین جدا
-			case 0xE3:		// غین آخر
-				map[i] = "\xD8\xBA";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xE4:		// غین اول
-			case 0xE5:		// غین وسط
-				map[i] = "\xD8\xBA";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xE6:		// ف آخر
-				map[i] = "\xD9\x81";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xE7:		// ف وسط
-				map[i] = "\xD9\x81";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xE8:		// قاف جدا
-				map[i] = "\xD9\x82";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xE9:		// قاف اول
-				map[i] = "\xD9\x82";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xEA:		// کاف آخر
-				map[i] = "\xDA\xA9";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xEB:		// کاف وسط
-				map[i] = "\xDA\xA9";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xEC:		// گاف آخر
-				map[i] = "\xDA\xAF";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xED:		// گاف اول
-				map[i] = "\xDA\xAF";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xEE:		// لام جدا
-				map[i] = "\xD9\x84";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xF0:		// لام اول و وسط
-				map[i] = "\xD9\x84";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xF1:		// میم جدا
-				map[i] = "\xD9\x85";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xF2:		// میم اول
-				map[i] = "\xD9\x85";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xF3:		// نون جدا
-				map[i] = "\xD9\x86";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xF4:		// نون اول
-				map[i] = "\xD9\x86";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xF6:		// ه آخر با ی ربط
-				map[i] = "\xD9\x87\xD9\x94";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xF5:		// ه آخر و جدا
-				map[i] = "\xD9\x87";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xF7:		// ه اول
-				map[i] = "\xD9\x87";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xF8:		// واو آخر و جدا
-				map[i] = "\xD9\x88";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xF9:		// ی جدا
-			case 0xFB:		// ی آخر
-				map[i] = "\xDB\x8C";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			case 0xFD:		// ی اول و وسط
-				map[i] = "\xDB\x8C";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_PREV;
-				break;
-			case 0xFA:		// ي عربی جدا
-			case 0xFC:		// ي عربی آخر
-				map[i] = "\xD9\x8A";
-				map_size[i] = 2;
-				map_joining[i] = JOINS_BOTH;
-				break;
-			default:
-				break;
+			fputs("Error: --split needs an input file\n", stderr);
+			return 1;
 		}
-	char map_en[256] = { 0 };
-	for (int i = 0; i < 256; ++i)
-		switch (i)
+		std::vector<PageMark> pages;
+		load_page_index(argv[arg], (const uint8_t*) addr, st.st_size, pages);
+		bool ok = write_split(outdir, split_mode, (const uint8_t*) addr, st.st_size, pages, jobs);
+		munmap(addr, st.st_size);
+		close(fd);
+		return ok ? 0 : 1;
+	}
+	if (analyze)
+	{
+		if (addr == MAP_FAILED || arg == argc)
 		{
-			case 0x20:
-				map_en[i] = ' ';
-				break;
-			case 0x6A:
-				map_en[i] = ')';
-				break;
-			case 0x6B:
-				map_en[i] = '(';
-				break;
-			case 0x8D:
-			case 0x8E:
-			case 0x8F:
-			case 0x90:
-			case 0x91:
-			case 0x92:
-			case 0x93:
-			case 0x94:
-			case 0x95:
-			case 0x96:
-			case 0x97:
-			case 0x98:
-			case 0x99:
-			case 0x9A:
-			case 0x9B:
-			case 0x9C:
-			case 0x9D:
-			case 0x9E:
-			case 0x9F:
-			case 0xA0:
-			case 0xA1:
-			case 0xA2:
-			case 0xA3:
-			case 0xA4:
-			case 0xA5:
-			case 0xA6:
-				map_en[i] = i + 'A' - 0x8D;
-				break;
-			case 0xA7:
-			case 0xA8:
-			case 0xA9:
-			case 0xAA:
-			case 0xAB:
-			case 0xAC:
-			case 0xAD:
-			case 0xAE:
-			case 0xAF:
-			case 0xB0:
-			case 0xB1:
-			case 0xB2:
-			case 0xB3:
-			case 0xB4:
-			case 0xB5:
-			case 0xB6:
-			case 0xB7:
-			case 0xB8:
-			case 0xB9:
-			case 0xBA:
-			case 0xBB:
-			case 0xBC:
-			case 0xBD:
-			case 0xBE:
-			case 0xBF:
-			case 0xC0:
-				map_en[i] = i + 'a' - 0xA7;
-				break;
-			default:
-				break;
+			fputs("Error: --analyze needs an input file\n", stderr);
+			return 1;
 		}
+		std::vector<PageMark> pages;
+		load_page_index(argv[arg], (const uint8_t*) addr, st.st_size, pages);
+		Output out(1);
+		write_analysis(out, (const uint8_t*) addr, st.st_size, pages, jobs);
+		munmap(addr, st.st_size);
+		close(fd);
+		if (!out.flush())
+		{
+			fputs("Error: Failed to write output\n", stderr);
+			return 1;
+		}
+		return 0;
+	}
+	if (query)
+	{
+		if (addr == MAP_FAILED || arg == argc)
+		{
+			fputs("Error: --grep needs an input file\n", stderr);
+			return 1;
+		}
+		EncodedMatcher matcher;
+		if (!matcher.compile(query))
+		{
+			if (matcher.too_large())
+				fputs("Error: Query has too many encodings\n", stderr);
+			else
+				fputs("Error: Query has no encoding\n", stderr);
+			return 1;
+		}
+		Output out(1);
+		grep(out, argv[arg], (const uint8_t*) addr, st.st_size, query, matcher);
+		munmap(addr, st.st_size);
+		close(fd);
+		if (!out.flush())
+		{
+			fputs("Error: Failed to write output\n", stderr);
+			return 1;
+		}
+		return 0;
+	}
 
-	puts(header);
-
-	uint8_t* buf = new uint8_t[MAX_SIZE];
-	size_t size = fread(buf, 1, MAX_SIZE, stdin);
+	DecoderState state;
+	const uint8_t* data = (const uint8_t*) addr;
+	const uint8_t* begin = data;
+	const uint8_t* stop = data + st.st_size;
+	std::vector<PageMark> pages;
+	size_t first = 0, last = 0;
+	if (volume >= 0 || cache_dir)
+	{
+		load_page_index(argv[arg], data, st.st_size, pages);
+		last = pages.size();
+	}
+	if (volume >= 0)
+	{
+		// Only the requested pages are decoded, starting in the state the
+		// page index recorded for the first of them
+		if (!find_pages(pages, volume, first_page, last_page, first, last))
+		{
+			fputs("Error: No such pages\n", stderr);
+			return 1;
+		}
+		begin = data + pages[first].offset;
+		if (last < pages.size())
+			stop = data + pages[last].offset;
+		state = pages[first].state();
+	}
 
-	bool english = false;
-	int span = 0;
-	const uint8_t* data = buf;
-	CharJoining prev_joining = JOINS_NONE;
-	std::string ltr_string;		// Used to reverse numbers and English parts
-	while (size > 0)
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	DecodeStats* stats = verbose || show_stats ? new DecodeStats(verbose) : NULL;
+	// Compressed output is handed to another thread a block at a time
+	Compressor* compressor = NULL;
+	if (compress)
+	{
+		compressor = new Compressor(1, compression);
+		if (!compressor->start())
+		{
+			fputs("Error: Failed to start compression\n", stderr);
+			return 1;
+		}
+	}
+	// With --io, an input file decoded whole on one job is read ahead, and
+	// output written behind, by requests in flight while decoding goes on
+	AsyncIo* async = NULL;
+	if (async_io && addr != MAP_FAILED && volume < 0 && !cache_dir && jobs == 1)
+	{
+		async = new AsyncIo(fd, st.st_size, 1);
+		if (!async->start(io_backend))
+		{
+			fputs("Error: Failed to read input file\n", stderr);
+			return 1;
+		}
+	}
+	Output& out = *(compressor ? new Output(*compressor) : async ? new Output(*async) : new Output(1));
+	Handler* writer = new_writer(format, out);
+	Decoder decoder(*writer, state, stats);
+	write_header(format, out);
+	if (async)
+	{
+		munmap(addr, st.st_size);
+		const uint8_t* block;
+		size_t size, keep = 0;
+		bool last;
+		uint64_t offset = 0;		// Of block in the input
+		while (async->next_block(keep, block, size, last))
+		{
+			const uint8_t* stop = last ? block + size : block + size - MAX_STEP;
+			size_t used = decoder.decode(block, stop, block + size, offset) - block;
+			keep = size - used;
+			offset += used;
+		}
+		if (async->failed())
+			fputs("Error: Failed to read input\n", stderr);
+	}
+	else if (addr != MAP_FAILED)
 	{
-		if (size > 6)
+		// Regular files are decoded straight out of a read-only mapping, so
+		// there is neither a copy nor a size limit.
+		if (cache_dir)
 		{
-			uint32_t signature = 0xFFFFFF & *(uint32_t*) data;
-			data += 3;
-			size -= 3;
-			switch (signature)
+			RenderCache cache(cache_dir, format_extensions[format]);
+			if (!cache.create())
 			{
-				case NEW_PAGE:
-				{
-					uint8_t volume = *data;
-					++data;
-					--size;
-					uint16_t page = *(uint16_t*) data;
-					data += 2;
-					size -= 2;
-					//printf("\n<hr /> جلد %d صفحه %d <hr />\n", volume, page);
-					printf("\n<hr /> جلد %s%s صفحه %s%s%s <hr />\n",
-							volume < 10 ? "" : digits_fa[volume / 10],
-							digits_fa[volume % 10],
-							page < 100 ? "" : digits_fa[page / 100],
-							page < 10 ? "" : digits_fa[(page % 100) / 10],
-							digits_fa[page % 10]);
-					prev_joining = JOINS_NONE;
-					break;
-				}
-				case ENGLISH_START:
-					english = true;
-					prev_joining = JOINS_NONE;
-					break;
-				case ENGLISH_END:
-					english = false;
-					prev_joining = JOINS_NONE;
-					break;
-				default:
-					data -= 3;
-					size += 3;
-					break;
+				fputs("Error: Failed to create cache directory\n", stderr);
+				return 1;
 			}
+			decode_cached(out, format, data, st.st_size, pages, first, last, volume < 0, jobs, cache, stats);
 		}
-		uint8_t byte = *data;
-		switch (byte)
+		else if (jobs > 1 && volume < 0)
+			decode_parallel(out, format, data, st.st_size, jobs, stats);
+		else
 		{
-			case 0x7D:		// آغاز یک بخش؟ تعیین رنگ و قلم؟
-			case 0x7E:		// آغاز یک بخش؟ تعیین رنگ و قلم؟
-				++data;
-				--size;
-				switch (*data)
-				{
-					case 0x01:		// عنوان
-						puts("<span class=\"title\">");
-						break;
-					case 0x03:		// حدیث
-						puts("<span class=\"hadith\">");
-						break;
-					case 0x04:		// آیه
-						puts("<span class=\"aya\">");
-						break;
-					case 0x05:		// شعر
-						puts("<span class=\"poem\">");
-						break;
-					case 0x08:		// ترجمه
-						puts("<span class=\"comment\">");
-						break;
-					case 0x0B:		// پاورقی
-						puts("<span class=\"footnote\">");
-						break;
-					case 0x0C:		// آیه در پاورقی
-						puts("<span class=\"footnote_aya\">");
-						break;
-					case 0x0D:		// حدیث در پاورقی
-						puts("<span class=\"footnote_hadith\">");
-						break;
-					case 0x0E:		// شعر در پاورقی
-						puts("<span class=\"footnote_poem\">");
-						break;
-					case 0x0F:		// توضیح در پاورقی
-						puts("<span class=\"footnote_comment\">");
-						break;
-					default:
-						printf("<span class=\"unknown_%#.2x\">\n", *data);
-						fprintf(stderr, "unknown formatting: %#.2x\n", *data);
-						break;
-				}
-				++span;
-				prev_joining = JOINS_NONE;
-				break;
-			case 0x80:		// اتمام یک بخش؟
-				if (span > 0)
-				{
-					puts("</span>");
-					--span;
-				}
-				prev_joining = JOINS_NONE;
-				break;
-			case 0x85:		// خط افقی (برای جدا کردن پاورقی)
-				puts("<hr class=\"hr_footnote\" />");
-				prev_joining = JOINS_NONE;
-				break;
-			default:
-				CharJoining my_joining = JOINS_NONE;
-				const char* to = NULL;
-				uint16_t to_size = 0;
-				if (english)
-				{
-					if (map_en[byte])
-					{
-						to = &map_en[byte];
-						to_size = 1;
-					}
-				}
-				else
-				{
-					to = map[byte];
-					to_size = map_size[byte];
-					my_joining = map_joining[byte];
-				}
-				if (to_size)
-				{
-					if (english || (0x8D <= byte && byte <= 0x96))
-						ltr_string = std::string(to, to_size) + ltr_string;
-					else
-					{
-						if (!ltr_string.empty())
-						{
-							ltr_string += RLM;
-							fwrite(ltr_string.data(), 1, ltr_string.size(), stdout);
-							ltr_string.clear();
-						}
-						if ((prev_joining & JOINS_NEXT) && (my_joining & JOINS_PREV))
-							fwrite(ZWNJ, 1, sizeof(ZWNJ) - 1, stdout);
-						fwrite(to, 1, to_size, stdout);
-					}
-				}
-				else if (!to)
-				{
-					printf("<!-- unknown byte [%#.2x] -->", byte);
-					fprintf(stderr, "unknown byte: %#.2x\n", byte);
-				}
-				prev_joining = my_joining;
+			size_t skip = (begin - data) & ~(size_t) (sysconf(_SC_PAGESIZE) - 1);
+			madvise((uint8_t*) addr + skip, stop - data - skip, MADV_SEQUENTIAL);
+			decoder.decode(begin, stop, data + st.st_size, begin - data);
+		}
+		munmap(addr, st.st_size);
+	}
+	else
+	{
+		// Pipes are decoded in fixed chunks.  The few bytes left undecoded
+		// at the end of a chunk are moved to the front of the next one, so
+		// signatures and format pairs split between chunks still match.
+		uint8_t* buf = new uint8_t[CHUNK_SIZE];
+		size_t size = 0;
+		uint64_t offset = 0;		// Of buf in the input
+		for (;;)
+		{
+			ssize_t got = read(fd, buf + size, CHUNK_SIZE - size);
+			if (got < 0)
+			{
+				fputs("Error: Failed to read input\n", stderr);
 				break;
+			}
+			size += got;
+			const uint8_t* stop = buf + size;
+			if (got && size > MAX_STEP)
+				stop -= MAX_STEP;
+			else if (got)
+				continue;
+			size_t used = decoder.decode(buf, stop, buf + size, offset) - buf;
+			if (got == 0)
+				break;
+			size -= used;
+			offset += used;
+			memmove(buf, buf + used, size);
 		}
-		++data;
-		--size;
+		delete [] buf;
+	}
+	decoder.finish();
+
+	write_footer(format, out);
+	delete writer;
+	uint64_t output_size = out.size();
+	bool written = out.flush();
+	delete &out;
+	if (compressor)
+	{
+		written = compressor->finish() && written;
+		delete compressor;
+	}
+	if (async)
+	{
+		written = async->finish() && written;
+		if (show_stats)
+			fprintf(stderr, "io: %s\n", async->backend());
+		delete async;
+	}
+	if (!written)
+	{
+		fputs("Error: Failed to write output\n", stderr);
+		return 1;
 	}
-	
-	puts(footer);
+	if (show_stats)
+		stats->print(stderr, output_size, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	delete stats;
 
-	delete [] buf;
+	close(fd);
 	return 0;
 }
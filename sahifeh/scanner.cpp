@@ -0,0 +1,79 @@
+#include "scanner.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+static inline bool is_control(uint8_t byte)
+{
+	return (uint8_t) (byte - CONTROL_FIRST) <= CONTROL_LAST - CONTROL_FIRST;
+}
+
+static const uint8_t* find_control_scalar(const uint8_t* data, const uint8_t* end)
+{
+	while (data < end && !is_control(*data))
+		++data;
+	return data;
+}
+
+// The vector versions move the range to the bottom of signed bytes, where a
+// single signed compare finds it.
+#define CONTROL_SHIFT (0x80 - CONTROL_FIRST)
+#define CONTROL_LIMIT ((int8_t) (0x80 + CONTROL_LAST - CONTROL_FIRST + 1))
+
+#ifdef __SSE2__
+static const uint8_t* find_control_sse2(const uint8_t* data, const uint8_t* end)
+{
+	const __m128i shift = _mm_set1_epi8(CONTROL_SHIFT);
+	const __m128i limit = _mm_set1_epi8(CONTROL_LIMIT);
+	for (; end - data >= 16; data += 16)
+	{
+		__m128i bytes = _mm_loadu_si128((const __m128i*) data);
+		__m128i control = _mm_cmpgt_epi8(limit, _mm_add_epi8(bytes, shift));
+		int mask = _mm_movemask_epi8(control);
+		if (mask)
+			return data + __builtin_ctz(mask);
+	}
+	return find_control_scalar(data, end);
+}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static const uint8_t* find_control_avx2(const uint8_t* data, const uint8_t* end)
+{
+	const __m256i shift = _mm256_set1_epi8(CONTROL_SHIFT);
+	const __m256i limit = _mm256_set1_epi8(CONTROL_LIMIT);
+	for (; end - data >= 32; data += 32)
+	{
+		__m256i bytes = _mm256_loadu_si256((const __m256i*) data);
+		__m256i control = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(bytes, shift));
+		unsigned mask = _mm256_movemask_epi8(control);
+		if (mask)
+			return data + __builtin_ctz(mask);
+	}
+	return find_control_scalar(data, end);
+}
+#endif
+
+typedef const uint8_t* (*FindControl)(const uint8_t* data, const uint8_t* end);
+
+static FindControl pick_find_control()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("avx2"))
+		return find_control_avx2;
+#endif
+#ifdef __SSE2__
+	return find_control_sse2;
+#else
+	return find_control_scalar;
+#endif
+}
+
+static const FindControl find_control_impl = pick_find_control();
+
+const uint8_t* find_control(const uint8_t* data, const uint8_t* end)
+{
+	return find_control_impl(data, end);
+}
@@ -0,0 +1,16 @@
+#ifndef SAHIFEH_SCANNER_H
+#define SAHIFEH_SCANNER_H
+
+#include <stdint.h>
+
+#define CONTROL_FIRST 0x7A
+#define CONTROL_LAST 0x85
+
+// Returns the first byte in data..end that may be a control byte, or end.
+// Control bytes (signature starts 0x7A, 0x81 and 0x82, format openers 0x7D
+// and 0x7E, the closer 0x80 and the footnote rule 0x85) all fall in
+// 0x7A..0x85, and that whole range is reported.  Everything before it is
+// plain glyphs.
+const uint8_t* find_control(const uint8_t* data, const uint8_t* end);
+
+#endif
@@ -0,0 +1,114 @@
+// Looks words and phrases up in an index built by sahifeh-index.
+//
+// Usage: sahifeh-search [--pages] index-file query
+//
+// The words of query are searched for as a phrase.  Each occurrence is
+// printed as a line of volume, page, word offset in the page and span class
+// (- outside spans), separated by tabs.  With --pages, each page is printed
+// once, as volume and page.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+#include "decoder.h"
+#include "word_index.h"
+
+class QuerySplitter : public WordSplitter
+{
+public:
+	explicit QuerySplitter(bool fold) : WordSplitter(fold) { }
+
+	std::vector<std::string> words;
+
+protected:
+	virtual void word(const std::string& word)
+	{
+		words.push_back(word);
+	}
+};
+
+static bool same_page(const WordPosting& a, const WordPosting& b)
+{
+	return a.page_no == b.page_no;
+}
+
+static bool before(const WordPosting& a, const WordPosting& b)
+{
+	return a.page_no < b.page_no || (a.page_no == b.page_no && a.offset < b.offset);
+}
+
+static void usage()
+{
+	fputs("Usage: sahifeh-search [--pages] index-file query\n", stderr);
+}
+
+int main(int argc, const char* argv[])
+{
+	bool pages_only = false;
+	int arg = 1;
+	if (arg < argc && !strcmp(argv[arg], "--pages"))
+	{
+		pages_only = true;
+		++arg;
+	}
+	if (argc - arg != 2)
+	{
+		usage();
+		return 1;
+	}
+	WordIndex index;
+	if (!index.open(argv[arg]))
+	{
+		fputs("Error: Failed to open index file\n", stderr);
+		return 1;
+	}
+	QuerySplitter query(index.folded());
+	query.add(argv[arg + 1], strlen(argv[arg + 1]));
+	query.end_word();
+	if (query.words.empty())
+	{
+		fputs("Error: No words in query\n", stderr);
+		return 1;
+	}
+
+	// Occurrences of the first word, followed by the rest of the phrase
+	std::vector<WordPosting> matches, next;
+	index.find(query.words[0], matches);
+	for (size_t i = 1; i < query.words.size() && !matches.empty(); ++i)
+	{
+		next.clear();
+		index.find(query.words[i], next);
+		size_t kept = 0;
+		for (size_t j = 0; j < matches.size(); ++j)
+		{
+			WordPosting wanted = matches[j];
+			wanted.offset += i;
+			if (std::binary_search(next.begin(), next.end(), wanted, before))
+				matches[kept++] = matches[j];
+		}
+		matches.resize(kept);
+	}
+
+	if (pages_only)
+		matches.erase(std::unique(matches.begin(), matches.end(), same_page), matches.end());
+	for (size_t i = 0; i < matches.size(); ++i)
+	{
+		const WordPosting& match = matches[i];
+		if (pages_only)
+		{
+			printf("%u\t%u\n", match.volume, match.page);
+			continue;
+		}
+		const char* name = span_class(match.format);
+		if (match.format == 0)
+			printf("%u\t%u\t%u\t-\n", match.volume, match.page, match.offset);
+		else if (name)
+			printf("%u\t%u\t%u\t%s\n", match.volume, match.page, match.offset, name);
+		else
+			printf("%u\t%u\t%u\tunknown_%#.2x\n", match.volume, match.page, match.offset, match.format);
+	}
+	return 0;
+}
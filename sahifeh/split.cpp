@@ -0,0 +1,227 @@
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "html.h"
+#include "output.h"
+#include "split.h"
+
+#define INDEX_NAME "index"
+
+struct Shard		// A file of a volume or a page
+{
+	size_t begin;
+	size_t end;
+	DecoderState state;
+	unsigned volume;	// 0 for text before the first page
+	unsigned page;		// First in it
+	std::string name;
+	std::string title;
+	bool failed;
+};
+
+static std::string persian_number(unsigned n)
+{
+	std::string text;
+	{
+		Output out(text);
+		out.number_fa(n);
+	}
+	return text;
+}
+
+// Adds a shard starting at page first, or at the start of input without it
+static void add_shard(std::vector<Shard>& shards, std::map<std::string, unsigned>& names,
+		size_t end, const PageMark* first, bool whole_volume)
+{
+	Shard shard;
+	shard.begin = first ? first->offset : 0;
+	shard.end = end;
+	shard.state = first ? first->state() : DecoderState();
+	shard.volume = first ? first->volume : 0;
+	shard.page = first ? first->page : 0;
+	char name[32];
+	if (first == NULL)
+		snprintf(name, sizeof(name), "front");
+	else if (whole_volume)
+		snprintf(name, sizeof(name), "v%02u", shard.volume);
+	else
+		snprintf(name, sizeof(name), "v%02u_p%04u", shard.volume, shard.page);
+	shard.name = name;
+	unsigned seen = ++names[shard.name];
+	if (seen > 1)		// The same volume or page again, further on
+	{
+		snprintf(name, sizeof(name), "_%u", seen);
+		shard.name += name;
+	}
+	if (first == NULL)
+		shard.title = "آغاز";
+	else
+	{
+		shard.title = "جلد " + persian_number(shard.volume);
+		if (!whole_volume)
+			shard.title += " صفحه " + persian_number(shard.page);
+	}
+	shard.failed = false;
+	shards.push_back(shard);
+}
+
+static void make_shards(SplitMode mode, size_t size, const std::vector<PageMark>& pages, std::vector<Shard>& shards)
+{
+	std::map<std::string, unsigned> names;
+	if (pages.empty() || pages[0].offset > 0)
+		add_shard(shards, names, pages.empty() ? size : pages[0].offset, NULL, false);
+	for (size_t i = 0; i < pages.size(); )
+	{
+		size_t next = i + 1;
+		if (mode == SPLIT_VOLUME)
+			while (next < pages.size() && pages[next].volume == pages[i].volume)
+				++next;
+		size_t end = next < pages.size() ? pages[next].offset : size;
+		add_shard(shards, names, end, &pages[i], mode == SPLIT_VOLUME);
+		i = next;
+	}
+}
+
+// Navigation between shards, and to the table of contents
+static std::string nav(const std::vector<Shard>& shards, size_t i)
+{
+	std::string links = "<div class=\"nav\">";
+	if (i > 0)
+		links += "<a href=\"" + shards[i - 1].name + ".html\">قبلی</a> | ";
+	links += "<a href=\"" INDEX_NAME ".html\">فهرست</a>";
+	if (i + 1 < shards.size())
+		links += " | <a href=\"" + shards[i + 1].name + ".html\">بعدی</a>";
+	return links + "</div>\n";
+}
+
+static std::string head_links(const std::vector<Shard>& shards, size_t i)
+{
+	std::string links;
+	if (i > 0)
+		links += "<link rel=\"prev\" href=\"" + shards[i - 1].name + ".html\" />\n";
+	if (i + 1 < shards.size())
+		links += "<link rel=\"next\" href=\"" + shards[i + 1].name + ".html\" />\n";
+	return links + "<link rel=\"contents\" href=\"" INDEX_NAME ".html\" />\n";
+}
+
+static bool write_shard(const std::string& dir, const std::vector<Shard>& shards, size_t i,
+		const uint8_t* data, size_t size)
+{
+	const Shard& shard = shards[i];
+	std::string path = dir + "/" + shard.name + ".html";
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0)
+		return false;
+	bool ok;
+	{
+		Output out(fd);
+		HtmlWriter writer(out);
+		std::string links = nav(shards, i);
+		writer.header(shard.title, head_links(shards, i));
+		out.write(links.data(), links.size());
+		writer.reopen(shard.state);
+		Decoder decoder(writer, shard.state);
+		decoder.decode(data + shard.begin, data + shard.end, data + size, shard.begin);
+		decoder.finish();
+		writer.close_spans(decoder.state().span);
+		out.write(links.data(), links.size());
+		writer.footer();
+		ok = out.flush();
+	}
+	ok = close(fd) == 0 && ok;
+	if (!ok)
+		unlink(path.c_str());
+	return ok;
+}
+
+// Table of contents: the volumes, or the pages of each volume
+static bool write_index(const std::string& dir, SplitMode mode, const std::vector<Shard>& shards)
+{
+	std::string path = dir + "/" INDEX_NAME ".html";
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0)
+		return false;
+	bool ok;
+	{
+		Output out(fd);
+		HtmlWriter writer(out);
+		writer.header("فهرست", shards.empty() ? "" : "<link rel=\"start\" href=\"" + shards[0].name + ".html\" />\n");
+		out.write("<div align=\"center\">بسم الله الرحمن الرحیم</div>\n\n");
+		bool listing = false;		// Pages of a volume
+		for (size_t i = 0; i < shards.size(); ++i)
+		{
+			const Shard& shard = shards[i];
+			if (mode == SPLIT_PAGE && shard.name != "front" && (!listing || shards[i - 1].volume != shard.volume))
+			{
+				if (listing)
+					out.write("</p>\n");
+				out.write("<h2>جلد ");
+				out.number_fa(shard.volume);
+				out.write("</h2>\n<p>\n");
+				listing = true;
+			}
+			out.write("<a href=\"");
+			out.write(shard.name.data(), shard.name.size());
+			out.write(".html\">");
+			if (listing)
+				out.number_fa(shard.page);
+			else
+				out.write(shard.title.data(), shard.title.size());
+			if (listing)
+				out.write("</a>\n");
+			else
+				out.write("</a><br />\n");
+		}
+		if (listing)
+			out.write("</p>\n");
+		writer.footer();
+		ok = out.flush();
+	}
+	ok = close(fd) == 0 && ok;
+	if (!ok)
+		unlink(path.c_str());
+	return ok;
+}
+
+bool write_split(const char* outdir, SplitMode mode, const uint8_t* data, size_t size,
+		const std::vector<PageMark>& pages, unsigned jobs)
+{
+	struct stat st;
+	if ((mkdir(outdir, 0777) != 0 && errno != EEXIST) || stat(outdir, &st) != 0 || !S_ISDIR(st.st_mode))
+	{
+		fputs("Error: Failed to create output directory\n", stderr);
+		return false;
+	}
+	std::string dir = outdir;
+	std::vector<Shard> shards;
+	make_shards(mode, size, pages, shards);
+
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < jobs; ++i)
+		threads.push_back(std::thread([&]()
+		{
+			for (size_t i; (i = next++) < shards.size(); )
+				shards[i].failed = !write_shard(dir, shards, i, data, size);
+		}));
+	bool ok = write_index(dir, mode, shards);
+	if (!ok)
+		fprintf(stderr, "Error: Failed to write %s/" INDEX_NAME ".html\n", outdir);
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+	for (size_t i = 0; i < shards.size(); ++i)
+		if (shards[i].failed)
+		{
+			fprintf(stderr, "Error: Failed to write %s/%s.html\n", outdir, shards[i].name.c_str());
+			ok = false;
+		}
+	return ok;
+}
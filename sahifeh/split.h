@@ -0,0 +1,25 @@
+#ifndef SAHIFEH_SPLIT_H
+#define SAHIFEH_SPLIT_H
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decoder.h"
+
+enum SplitMode
+{
+	SPLIT_VOLUME,
+	SPLIT_PAGE,
+};
+
+// Writes input as XHTML files in outdir, one per volume or per page of
+// pages, each linking to the one before and after it, and index.html
+// linking to all of them.  Text before the first page goes in front.html.
+// Spans open where a file starts are opened again in it, and closed at its
+// end.  Files are written on jobs threads.  Returns false, having reported
+// why, if any could not be written.
+bool write_split(const char* outdir, SplitMode mode, const uint8_t* data, size_t size,
+		const std::vector<PageMark>& pages, unsigned jobs);
+
+#endif
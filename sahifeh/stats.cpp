@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cstring>
+
+#include "stats.h"
+
+DecodeStats::DecodeStats(bool verbose)
+	: verbose(verbose), pages(0), max_span(0), unbalanced_closes(0), english_bytes(0), longest_english(0)
+{
+	memset(bytes, 0, sizeof(bytes));
+	memset(unknown_bytes, 0, sizeof(unknown_bytes));
+	memset(unknown_formats, 0, sizeof(unknown_formats));
+	memset(volume_pages, 0, sizeof(volume_pages));
+	memset(english_runs, 0, sizeof(english_runs));
+	std::fill(unknown_byte_offsets, unknown_byte_offsets + 256, NO_OFFSET);
+	std::fill(unknown_format_offsets, unknown_format_offsets + 256, NO_OFFSET);
+}
+
+void DecodeStats::unknown_byte(uint8_t byte, uint64_t offset)
+{
+	++unknown_bytes[byte];
+	unknown_byte_offsets[byte] = std::min(unknown_byte_offsets[byte], offset);
+	if (verbose)
+		fprintf(stderr, "unknown byte: %#.2x\n", byte);
+}
+
+void DecodeStats::unknown_format(uint8_t format, uint64_t offset)
+{
+	++unknown_formats[format];
+	unknown_format_offsets[format] = std::min(unknown_format_offsets[format], offset);
+	if (verbose)
+		fprintf(stderr, "unknown formatting: %#.2x\n", format);
+}
+
+void DecodeStats::english_run(uint64_t length)
+{
+	int n = 0;
+	while (n + 1 < RUN_LENGTH_CLASSES && length >> (n + 1))
+		++n;
+	++english_runs[n];
+	english_bytes += length;
+	longest_english = std::max(longest_english, length);
+}
+
+void DecodeStats::merge(const DecodeStats& other)
+{
+	for (int i = 0; i < 256; ++i)
+	{
+		bytes[i] += other.bytes[i];
+		unknown_bytes[i] += other.unknown_bytes[i];
+		unknown_byte_offsets[i] = std::min(unknown_byte_offsets[i], other.unknown_byte_offsets[i]);
+		unknown_formats[i] += other.unknown_formats[i];
+		unknown_format_offsets[i] = std::min(unknown_format_offsets[i], other.unknown_format_offsets[i]);
+		volume_pages[i] += other.volume_pages[i];
+	}
+	for (int i = 0; i < RUN_LENGTH_CLASSES; ++i)
+		english_runs[i] += other.english_runs[i];
+	pages += other.pages;
+	max_span = std::max(max_span, other.max_span);
+	unbalanced_closes += other.unbalanced_closes;
+	english_bytes += other.english_bytes;
+	longest_english = std::max(longest_english, other.longest_english);
+}
+
+void DecodeStats::print(FILE* f, uint64_t output_size, double seconds) const
+{
+	uint64_t input_size = 0, unknown = 0, unknown_kinds = 0, formats = 0, format_kinds = 0;
+	unsigned volumes = 0;
+	for (int i = 0; i < 256; ++i)
+	{
+		input_size += bytes[i];
+		unknown += unknown_bytes[i];
+		unknown_kinds += unknown_bytes[i] != 0;
+		formats += unknown_formats[i];
+		format_kinds += unknown_formats[i] != 0;
+		volumes += volume_pages[i] != 0;
+	}
+	uint64_t runs = 0;
+	for (int i = 0; i < RUN_LENGTH_CLASSES; ++i)
+		runs += english_runs[i];
+
+	fprintf(f, "bytes in: %llu\n", (unsigned long long) input_size);
+	fprintf(f, "bytes out: %llu\n", (unsigned long long) output_size);
+	fprintf(f, "seconds: %.3f\n", seconds);
+	fprintf(f, "speed: %.2f MB/s\n", seconds > 0 ? input_size / seconds / 1e6 : 0.0);
+	fprintf(f, "pages: %llu\n", (unsigned long long) pages);
+	fprintf(f, "volumes: %u\n", volumes);
+	for (int i = 0; i < 256; ++i)
+		if (volume_pages[i])
+			fprintf(f, "\tvolume %d: %llu pages\n", i, (unsigned long long) volume_pages[i]);
+	fprintf(f, "deepest span: %d\n", max_span);
+	fprintf(f, "unbalanced span closes: %llu\n", (unsigned long long) unbalanced_closes);
+	fprintf(f, "unknown formats: %llu of %llu kinds\n", (unsigned long long) formats, (unsigned long long) format_kinds);
+	for (int i = 0; i < 256; ++i)
+		if (unknown_formats[i])
+			fprintf(f, "\t%#.2x: %llu, first at %llu\n", i, (unsigned long long) unknown_formats[i],
+					(unsigned long long) unknown_format_offsets[i]);
+	fprintf(f, "unknown bytes: %llu of %llu kinds\n", (unsigned long long) unknown, (unsigned long long) unknown_kinds);
+	for (int i = 0; i < 256; ++i)
+		if (unknown_bytes[i])
+			fprintf(f, "\t%#.2x: %llu, first at %llu\n", i, (unsigned long long) unknown_bytes[i],
+					(unsigned long long) unknown_byte_offsets[i]);
+	fprintf(f, "english runs: %llu, %llu bytes, longest %llu\n", (unsigned long long) runs,
+			(unsigned long long) english_bytes, (unsigned long long) longest_english);
+	for (int i = 0; i < RUN_LENGTH_CLASSES; ++i)
+		if (english_runs[i])
+			fprintf(f, "\t%llu-%llu bytes: %llu\n", i ? 1ULL << i : 0ULL, (2ULL << i) - 1,
+					(unsigned long long) english_runs[i]);
+	fputs("byte histogram:\n", f);
+	for (int row = 0; row < 256; row += 16)
+	{
+		fprintf(f, "\t%.2x:", row);
+		for (int i = row; i < row + 16; ++i)
+			fprintf(f, " %llu", (unsigned long long) bytes[i]);
+		fputc('\n', f);
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef SAHIFEH_STATS_H
+#define SAHIFEH_STATS_H
+
+#include <cstdio>
+#include <stdint.h>
+
+#define RUN_LENGTH_CLASSES 24		// English runs of 1, 2-3, 4-7, ... bytes
+#define NO_OFFSET UINT64_MAX
+
+// What a Decoder counts of its input, for sahifeh --stats.  Rare events
+// are counted as they are found, and the byte histogram once per call of
+// Decoder::decode(), so that the glyph loop stays as it is.
+struct DecodeStats
+{
+	bool verbose;		// Also report each unknown byte and format on stderr
+	uint64_t bytes[256];			// Histogram of the input
+	uint64_t unknown_bytes[256];
+	uint64_t unknown_byte_offsets[256];		// Of the first of each
+	uint64_t unknown_formats[256];
+	uint64_t unknown_format_offsets[256];	// Of the first of each
+	uint64_t pages;
+	uint64_t volume_pages[256];
+	int max_span;		// Deepest nesting of spans
+	uint64_t unbalanced_closes;		// With no span open
+	uint64_t english_runs[RUN_LENGTH_CLASSES];	// By length class
+	uint64_t english_bytes;
+	uint64_t longest_english;
+
+	explicit DecodeStats(bool verbose = false);
+
+	void unknown_byte(uint8_t byte, uint64_t offset);
+	void unknown_format(uint8_t format, uint64_t offset);
+	void english_run(uint64_t length);
+
+	void merge(const DecodeStats& other);		// Of another part of the input
+
+	// Prints a report of everything counted, and of the output size and the
+	// time taken for all of it
+	void print(FILE* f, uint64_t output_size, double seconds) const;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#include "text.h"
+
+void TextWriter::page(unsigned volume, unsigned page)
+{
+	out.write("\n\n");
+}
+
+void TextWriter::text(const char* text, size_t size)
+{
+	out.write(text, size);
+}
+
+void TextWriter::ltr(const char* text, size_t size)
+{
+	out.write(text, size);
+}
+
+void TextWriter::line_break()
+{
+	out.put('\n');
+}
+
+void TextWriter::tab()
+{
+	out.put('\t');
+}
+
+void TextWriter::footnote_rule()
+{
+	out.put('\n');
+}
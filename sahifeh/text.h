@@ -0,0 +1,25 @@
+#ifndef SAHIFEH_TEXT_H
+#define SAHIFEH_TEXT_H
+
+#include "decoder.h"
+#include "output.h"
+
+// Writes decoded text as plain UTF-8, with line breaks and tabs as they are
+// and a blank line before each page.  Spans and page numbers are dropped.
+class TextWriter : public Handler
+{
+public:
+	explicit TextWriter(Output& out) : out(out) { }
+
+	virtual void page(unsigned volume, unsigned page);
+	virtual void text(const char* text, size_t size);
+	virtual void ltr(const char* text, size_t size);
+	virtual void line_break();
+	virtual void tab();
+	virtual void footnote_rule();
+
+private:
+	Output& out;
+};
+
+#endif
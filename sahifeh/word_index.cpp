@@ -0,0 +1,369 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "word_index.h"
+
+// An index file is laid out for use straight out of a mapping, in host
+// byte order:
+//
+//	WordIndexHeader
+//	uint32_t pages[page_count]		volume << 16 | page, in input order
+//	WordIndexTerm terms[term_count]	sorted by word, bytewise
+//	words, pointed to by terms
+//	postings, pointed to by terms
+//
+// The postings of a word are, for each occurrence, the varints of its
+// page_no, less that of the one before, and of its offset, less that of the
+// one before when on the same page, followed by the format byte.
+
+#define WORD_INDEX_MAGIC "SAHIFWIX"
+#define WORD_INDEX_VERSION 1
+#define WORD_INDEX_FOLDED 1		// Flag of diacritics folded
+
+struct WordIndexHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint32_t page_count;
+	uint32_t term_count;
+	uint64_t terms_offset;
+	uint64_t words_offset;
+	uint64_t postings_offset;
+	uint64_t size;		// Of the whole file
+};
+
+struct WordIndexTerm
+{
+	uint64_t postings;		// From postings_offset
+	uint32_t postings_size;
+	uint32_t count;
+	uint32_t word;			// From words_offset
+	uint32_t word_size;
+};
+
+enum CharKind
+{
+	CHAR_SPACE,		// Ends a word
+	CHAR_WORD,
+	CHAR_MARK,		// Diacritic
+	CHAR_IGNORED,	// Tatweel and ZWNJ
+};
+
+static CharKind char_kind(uint32_t c)
+{
+	if (c < 0x80)
+		return isalnum(c) ? CHAR_WORD : CHAR_SPACE;
+	if ((0x064B <= c && c <= 0x065F) || c == 0x0670)
+		return CHAR_MARK;
+	if (c == 0x0640 || c == 0x200C)
+		return CHAR_IGNORED;
+	if ((0x0621 <= c && c <= 0x063A) || (0x0641 <= c && c <= 0x064A) || (0x0660 <= c && c <= 0x0669)
+			|| (0x066E <= c && c <= 0x06D3) || c == 0x06D5 || (0x06EE <= c && c <= 0x06FF))
+		return CHAR_WORD;
+	return CHAR_SPACE;
+}
+
+void WordSplitter::add(const char* text, size_t size)
+{
+	const uint8_t* p = (const uint8_t*) text;
+	const uint8_t* end = p + size;
+	while (p < end)
+	{
+		uint32_t c = *p;
+		size_t length = 1;
+		if (c >= 0xF0)
+		{
+			length = 4;
+			c &= 0x07;
+		}
+		else if (c >= 0xE0)
+		{
+			length = 3;
+			c &= 0x0F;
+		}
+		else if (c >= 0xC0)
+		{
+			length = 2;
+			c &= 0x1F;
+		}
+		length = std::min(length, (size_t) (end - p));
+		for (size_t i = 1; i < length; ++i)
+			c = c << 6 | (p[i] & 0x3F);
+		switch (char_kind(c))
+		{
+			case CHAR_WORD:
+				if (c < 0x80)
+					current.push_back(tolower(c));
+				else
+					current.append((const char*) p, length);
+				break;
+			case CHAR_MARK:
+				if (!fold)
+					current.append((const char*) p, length);
+				break;
+			case CHAR_IGNORED:
+				break;
+			default:
+				end_word();
+				break;
+		}
+		p += length;
+	}
+}
+
+void WordSplitter::end_word()
+{
+	if (current.empty())
+		return;
+	word(current);
+	current.clear();
+}
+
+static void put_varint(std::string& data, uint32_t n)
+{
+	for (; n >= 0x80; n >>= 7)
+		data.push_back((char) (n | 0x80));
+	data.push_back((char) n);
+}
+
+static bool get_varint(const uint8_t*& p, const uint8_t* end, uint32_t& n)
+{
+	n = 0;
+	for (int shift = 0; p < end && shift < 32; shift += 7)
+	{
+		n |= (uint32_t) (*p & 0x7F) << shift;
+		if (!(*p++ & 0x80))
+			return true;
+	}
+	return false;
+}
+
+WordIndexer::WordIndexer(bool fold) : WordSplitter(fold), fold(fold), pages(1, 0), offset(0)
+{
+}
+
+void WordIndexer::word(const std::string& word)
+{
+	Postings& postings = words[word];
+	uint32_t page_no = pages.size() - 1;
+	put_varint(postings.data, page_no - postings.last_page);
+	put_varint(postings.data, page_no == postings.last_page ? offset - postings.last_offset : offset);
+	postings.data.push_back((char) spans.format());
+	++postings.count;
+	postings.last_page = page_no;
+	postings.last_offset = offset++;
+}
+
+void WordIndexer::begin(const DecoderState& state)
+{
+	spans = state;
+}
+
+void WordIndexer::end()
+{
+	end_word();
+}
+
+void WordIndexer::page(unsigned volume, unsigned page)
+{
+	end_word();
+	pages.push_back(volume << 16 | page);
+	offset = 0;
+}
+
+void WordIndexer::span_open(uint8_t format)
+{
+	end_word();
+	spans.open(format);
+}
+
+void WordIndexer::span_close()
+{
+	end_word();
+	if (spans.span > 0)
+		--spans.span;
+}
+
+void WordIndexer::text(const char* text, size_t size)
+{
+	add(text, size);
+}
+
+void WordIndexer::ltr(const char* text, size_t size)
+{
+	end_word();
+	add(text, size);
+	end_word();
+}
+
+void WordIndexer::line_break()
+{
+	end_word();
+}
+
+void WordIndexer::tab()
+{
+	end_word();
+}
+
+void WordIndexer::footnote_rule()
+{
+	end_word();
+}
+
+void WordIndexer::unknown_byte(uint8_t byte, uint64_t offset)
+{
+	end_word();
+}
+
+bool WordIndexer::save(const char* path)
+{
+	typedef std::unordered_map<std::string, Postings>::const_iterator Word;
+	std::vector<Word> sorted;
+	sorted.reserve(words.size());
+	for (Word i = words.begin(); i != words.end(); ++i)
+		sorted.push_back(i);
+	std::sort(sorted.begin(), sorted.end(), [](const Word& a, const Word& b) { return a->first < b->first; });
+
+	WordIndexHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, WORD_INDEX_MAGIC, sizeof(header.magic));
+	header.version = WORD_INDEX_VERSION;
+	header.flags = fold ? WORD_INDEX_FOLDED : 0;
+	header.page_count = pages.size();
+	header.term_count = sorted.size();
+	size_t pages_end = sizeof(header) + pages.size() * sizeof(uint32_t);
+	header.terms_offset = (pages_end + 7) & ~(uint64_t) 7;
+	std::vector<WordIndexTerm> terms(sorted.size());
+	uint64_t words_size = 0, postings_size = 0;
+	for (size_t i = 0; i < sorted.size(); ++i)
+	{
+		terms[i].postings = postings_size;
+		terms[i].postings_size = sorted[i]->second.data.size();
+		terms[i].count = sorted[i]->second.count;
+		terms[i].word = words_size;
+		terms[i].word_size = sorted[i]->first.size();
+		words_size += terms[i].word_size;
+		postings_size += terms[i].postings_size;
+	}
+	if (words_size > UINT32_MAX)
+		return false;
+	header.words_offset = header.terms_offset + terms.size() * sizeof(WordIndexTerm);
+	header.postings_offset = header.words_offset + words_size;
+	header.size = header.postings_offset + postings_size;
+
+	FILE* f = fopen(path, "wb");
+	if (f == NULL)
+		return false;
+	static const char padding[8] = { 0 };
+	size_t padding_size = header.terms_offset - pages_end;
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+		&& fwrite(pages.data(), sizeof(uint32_t), pages.size(), f) == pages.size()
+		&& fwrite(padding, 1, padding_size, f) == padding_size
+		&& fwrite(terms.data(), sizeof(WordIndexTerm), terms.size(), f) == terms.size();
+	for (size_t i = 0; ok && i < sorted.size(); ++i)
+		ok = fwrite(sorted[i]->first.data(), 1, sorted[i]->first.size(), f) == sorted[i]->first.size();
+	for (size_t i = 0; ok && i < sorted.size(); ++i)
+		ok = fwrite(sorted[i]->second.data.data(), 1, sorted[i]->second.data.size(), f) == sorted[i]->second.data.size();
+	return fclose(f) == 0 && ok;
+}
+
+WordIndex::WordIndex() : data(NULL), size(0)
+{
+}
+
+WordIndex::~WordIndex()
+{
+	if (data)
+		munmap((void*) data, size);
+}
+
+bool WordIndex::open(const char* path)
+{
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	void* addr = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(WordIndexHeader))
+		addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+		return false;
+	data = (const uint8_t*) addr;
+	size = st.st_size;
+
+	const WordIndexHeader& header = *(const WordIndexHeader*) data;
+	uint64_t pages_end = sizeof(header) + (uint64_t) header.page_count * sizeof(uint32_t);
+	return !memcmp(header.magic, WORD_INDEX_MAGIC, sizeof(header.magic))
+		&& header.version == WORD_INDEX_VERSION
+		&& header.size == size
+		&& pages_end <= header.terms_offset && header.terms_offset % 8 == 0
+		&& header.terms_offset + (uint64_t) header.term_count * sizeof(WordIndexTerm) == header.words_offset
+		&& header.words_offset <= header.postings_offset && header.postings_offset <= size;
+}
+
+bool WordIndex::folded() const
+{
+	return ((const WordIndexHeader*) data)->flags & WORD_INDEX_FOLDED;
+}
+
+bool WordIndex::find(const std::string& word, std::vector<WordPosting>& postings) const
+{
+	const WordIndexHeader& header = *(const WordIndexHeader*) data;
+	const uint32_t* pages = (const uint32_t*) (data + sizeof(header));
+	const WordIndexTerm* terms = (const WordIndexTerm*) (data + header.terms_offset);
+	const char* words = (const char*) (data + header.words_offset);
+	size_t words_size = header.postings_offset - header.words_offset;
+
+	// Binary search of the sorted terms
+	size_t low = 0, high = header.term_count;
+	while (low < high)
+	{
+		size_t middle = low + (high - low) / 2;
+		const WordIndexTerm& term = terms[middle];
+		if ((uint64_t) term.word + term.word_size > words_size)
+			return false;
+		int order = word.compare(0, std::string::npos, words + term.word, term.word_size);
+		if (order == 0)
+		{
+			low = middle;
+			break;
+		}
+		if (order < 0)
+			high = middle;
+		else
+			low = middle + 1;
+	}
+	if (low >= high)
+		return false;
+
+	const WordIndexTerm& term = terms[low];
+	if (term.postings + term.postings_size > size - header.postings_offset)
+		return false;
+	const uint8_t* p = data + header.postings_offset + term.postings;
+	const uint8_t* end = p + term.postings_size;
+	WordPosting posting = { 0, 0, 0, 0, 0 };
+	for (uint32_t i = 0; i < term.count; ++i)
+	{
+		uint32_t page_delta, offset;
+		if (!get_varint(p, end, page_delta) || !get_varint(p, end, offset) || p == end)
+			return false;
+		posting.page_no += page_delta;
+		posting.offset = page_delta ? offset : posting.offset + offset;
+		posting.format = *p++;
+		if (posting.page_no >= header.page_count)
+			return false;
+		posting.volume = pages[posting.page_no] >> 16;
+		posting.page = pages[posting.page_no] & 0xFFFF;
+		postings.push_back(posting);
+	}
+	return true;
+}
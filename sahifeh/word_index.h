@@ -0,0 +1,103 @@
+#ifndef SAHIFEH_WORD_INDEX_H
+#define SAHIFEH_WORD_INDEX_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decoder.h"
+
+// Splits decoded text into words: runs of Persian and Arabic letters and
+// digits, or of ASCII letters and digits, lowercased.  Tatweel and ZWNJ are
+// dropped from words.  With fold, so are diacritics (what bytes 0x97 to 0xAD
+// decode to), so that a word matches however it was vowelled.
+class WordSplitter
+{
+public:
+	explicit WordSplitter(bool fold) : fold(fold) { }
+	virtual ~WordSplitter() { }
+
+	void add(const char* text, size_t size);	// Calls word() for each word it ends
+	void end_word();
+
+protected:
+	virtual void word(const std::string& word) = 0;
+
+private:
+	bool fold;
+	std::string current;
+};
+
+// Collects the words of decoder events into an inverted index.
+class WordIndexer : public Handler, private WordSplitter
+{
+public:
+	explicit WordIndexer(bool fold);
+
+	// Writes the index file; see word_index.cpp for its layout
+	bool save(const char* path);
+
+	virtual void begin(const DecoderState& state);
+	virtual void end();
+	virtual void page(unsigned volume, unsigned page);
+	virtual void span_open(uint8_t format);
+	virtual void span_close();
+	virtual void text(const char* text, size_t size);
+	virtual void ltr(const char* text, size_t size);
+	virtual void line_break();
+	virtual void tab();
+	virtual void footnote_rule();
+	virtual void unknown_byte(uint8_t byte, uint64_t offset);
+
+private:
+	struct Postings		// Of one word, encoded as they are added
+	{
+		std::string data;
+		uint32_t count;
+		uint32_t last_page;
+		uint32_t last_offset;
+	};
+
+	virtual void word(const std::string& word);
+
+	bool fold;
+	DecoderState spans;		// Formats of the open spans
+	std::vector<uint32_t> pages;		// Volume << 16 | page, in input order
+	uint32_t offset;		// Of the next word in its page
+	std::unordered_map<std::string, Postings> words;
+};
+
+struct WordPosting		// An occurrence of a word
+{
+	uint32_t page_no;	// Of the page in input order, 0 being text before any page
+	uint8_t volume;
+	uint16_t page;
+	uint32_t offset;	// Words before it in the page
+	uint8_t format;		// Of the innermost span it is in, or 0
+};
+
+// A word index file, mapped into memory.
+class WordIndex
+{
+public:
+	WordIndex();
+	~WordIndex();
+
+	bool open(const char* path);
+	bool folded() const;
+
+	// Appends the occurrences of word, in input order, and returns whether
+	// there were any
+	bool find(const std::string& word, std::vector<WordPosting>& postings) const;
+
+private:
+	WordIndex(const WordIndex&);
+	WordIndex& operator=(const WordIndex&);
+
+	const uint8_t* data;
+	size_t size;
+};
+
+#endif
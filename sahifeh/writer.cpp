@@ -0,0 +1,31 @@
+#include "html.h"
+#include "jsonl.h"
+#include "text.h"
+#include "writer.h"
+
+const char* const format_extensions[] = { "html", "txt", "jsonl" };
+
+Handler* new_writer(Format format, Output& out)
+{
+	switch (format)
+	{
+		case FORMAT_TEXT:
+			return new TextWriter(out);
+		case FORMAT_JSONL:
+			return new JsonlWriter(out);
+		default:
+			return new HtmlWriter(out);
+	}
+}
+
+void write_header(Format format, Output& out)
+{
+	if (format == FORMAT_HTML)
+		HtmlWriter(out).header();
+}
+
+void write_footer(Format format, Output& out)
+{
+	if (format == FORMAT_HTML)
+		HtmlWriter(out).footer();
+}
@@ -0,0 +1,23 @@
+#ifndef SAHIFEH_WRITER_H
+#define SAHIFEH_WRITER_H
+
+#include "decoder.h"
+#include "output.h"
+
+enum Format		// Of decoded output
+{
+	FORMAT_HTML,
+	FORMAT_TEXT,
+	FORMAT_JSONL,
+};
+
+extern const char* const format_extensions[];		// By format, like "html"
+
+// Handler writing format to out, to be deleted by the caller
+Handler* new_writer(Format format, Output& out);
+
+// What goes before and after the decoded text of a document
+void write_header(Format format, Output& out);
+void write_footer(Format format, Output& out);
+
+#endif